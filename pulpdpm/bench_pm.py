@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""Cost of the PowerManager MMIO handling.
+
+Runs the pm_mmio_bench.c firmware with no PowerManager write and with
+NB_WRITES iterations of 2 writes each, so that the difference of the two wall
+times only comes from the writes and not from the boot, the ISS or the
+launcher. This is done for each build of the PowerManager:
+
+    trace:    debug traces compiled in and enabled (--trace=pm)
+    notrace:  debug traces compiled in but disabled
+    release:  debug traces compiled out (PM_NO_TRACE)
+
+Each run is repeated and the fastest one is kept. GVSoC is rebuilt between the
+builds, with and without PM_RELEASE=1, and is left in the release build.
+"""
+
+import argparse
+import os
+import subprocess
+import time
+
+CONFIGS = [
+    ("trace", "0", ["--trace=pm"]),
+    ("notrace", "0", []),
+    ("release", "1", []),
+]
+
+
+def make(args, *targets, **variables):
+    subprocess.run(
+        ["make", "-C", args.target_dir, *targets, *[f"{name}={value}" for name, value in variables.items()]],
+        check=True, stdout=subprocess.DEVNULL,
+    )
+
+
+def run(args, nb_writes, runner_args):
+    """Returns the shortest wall time in s of the benchmark with nb_writes iterations."""
+    make(args, "app", SOURCE="pm_mmio_bench.c", APP_FLAGS=f"-DNB_WRITES={nb_writes}")
+    subprocess.run(
+        ["gvsoc", f"--target-dir={args.target_dir}", "--target=my_system", f"--work-dir={args.work_dir}",
+         f"--binary={args.binary}", "prepare", *runner_args],
+        check=True, stdout=subprocess.DEVNULL,
+    )
+
+    best = None
+    for _ in range(args.repeat):
+        start = time.monotonic()
+        subprocess.run(
+            [args.launcher, f"--config={os.path.join(args.work_dir, 'gvsoc_config.json')}"],
+            check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+        )
+        wall = time.monotonic() - start
+        best = wall if best is None else min(best, wall)
+    return best
+
+
+def main():
+    target_dir = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-n", "--writes", type=int, default=100000, help="iterations of the benchmark, 2 writes each")
+    parser.add_argument("--repeat", type=int, default=3, help="runs of each measure, the fastest is kept")
+    parser.add_argument("--work-dir", default=os.path.join(target_dir, "build"))
+    parser.add_argument("--launcher", default=os.path.join(target_dir, "launcher"), help="path of the launcher")
+    parser.add_argument("--binary", default=os.path.join(target_dir, "app/BUILD/PULP/GCC_RISCV/test/test"))
+    args = parser.parse_args()
+    args.target_dir = target_dir
+
+    print(f"{'build':<10}{'baseline (s)':>14}{'run (s)':>12}{'per write (ns)':>16}")
+    for name, release, runner_args in CONFIGS:
+        make(args, "gvsoc", PM_RELEASE=release)
+        baseline = run(args, 0, runner_args)
+        total = run(args, args.writes, runner_args)
+        per_write = (total - baseline) / (2 * args.writes) * 1e9
+        print(f"{name:<10}{baseline:>14.3f}{total:>12.3f}{per_write:>16.1f}")
+
+    return 0
+
+
+if __name__ == "__main__":
+    exit(main())
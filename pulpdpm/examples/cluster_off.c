@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "../pm_addr.h"
+#include "pmsis.h"
+#include "pm_functions.h"
+
+// needs a system configured with runner_args=--pm-pulp-domains, which defines
+// the offsets of the internal domains of pulp_open
+#define sensor1 0x20000000
+
+int main()
+{
+    volatile uint32_t *sensor = (volatile uint32_t *)sensor1;
+
+    // the internal domains follow the host until the firmware sets them, so
+    // the FC, the L2 banks and the peripherals stay on with it. The shared L2
+    // banks are interleaved, so none of them can be switched off while the L2
+    // is used. Only the cluster is switched off for the low-rate loop.
+    switch_on();
+    switch_off_domain(cluster_offset);
+    switch_on_domain(sensor1_offset);
+    capture_start();
+
+    uint32_t sum = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        sum += *sensor;
+        pi_time_wait_us(1000);
+    }
+
+    capture_stop();
+    printf("Sum of the samples: %u\n", sum);
+    printf("Average consumption: %f\n", get_power_consumption());
+    return 0;
+}
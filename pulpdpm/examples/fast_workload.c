@@ -8,6 +8,8 @@ int main()
 {
     // turn on the power consumption
     switch_on();
+    // the parameters given to the launcher apply from here
+    marker(marker_setup);
     // start recording power consumption
     capture_start();
     printf("Start workload\n");
@@ -7,6 +7,8 @@
 int main()
 {
     switch_on();
+    // the parameters given to the launcher apply from here
+    marker(marker_setup);
     capture_start();
     printf("Start workload\n");
     for (int j = 0; j < 100; j++)
@@ -9,6 +9,8 @@ int main()
 {
     config_state_delays(delay_on_sleep, delay_sleep_on, delay_on_idle, delay_idle_on);
     switch_on();
+    // the parameters given to the launcher apply from here
+    marker(marker_setup);
     capture_start();
     printf("Start workload\n");
     for (int j = 0; j < 100; j++)
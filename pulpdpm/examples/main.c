@@ -22,6 +22,11 @@ int main()
     *(pm_config_delay + host_config_offset + cg_on_offset) = 30000;
     *(pm_config_delay + host_config_offset + on_cg_offset) = 40000;
 
+    // the sensors reject accesses while they are off
+    *(pm_state_ptr + sensor1_offset) = on;
+    *(pm_state_ptr + sensor2_offset) = on;
+    *(pm_state_ptr + sensor3_offset) = on;
+
     // read sensor
     int data1, data2, data3;
     
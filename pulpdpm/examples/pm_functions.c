@@ -5,6 +5,7 @@ volatile float *pm_voltage_ptr = (volatile float *)pm_voltage;
 volatile int *pm_report_ptr = (volatile int *)pm_report;
 volatile int *pm_config_delay_states_ptr = (volatile int *)pm_config_delay_state;
 volatile int *pm_config_delay_voltage_ptr = (volatile int *)pm_config_delay_voltage;
+volatile uint32_t *pm_activity_ptr = (volatile uint32_t *)pm_activity;
 const int delay_idle_on_us = delay_idle_on / 1000000;
 const int delay_sleep_on_us = delay_sleep_on / 1000000;
 
@@ -40,6 +41,11 @@ void capture_stop()
     *(pm_report_ptr) = stop_capture;
 }
 
+void marker(int id)
+{
+    *(pm_report_ptr + marker_offset) = id;
+}
+
 double get_power_consumption()
 {
     return *(double *)(pm_report);
@@ -57,6 +63,25 @@ void switch_on()
     *(pm_state_ptr + host_offset) = on;
 }
 
+uint64_t get_activity(int domain, int counter)
+{
+    volatile uint32_t *window = pm_activity_ptr + domain * activity_window_words + counter;
+    // the low word samples the counters, the high word comes from the same sample
+    uint32_t low = window[0];
+    uint32_t high = window[1];
+    return ((uint64_t)high << 32) | low;
+}
+
+void switch_on_domain(int domain)
+{
+    *(pm_state_ptr + domain) = on;
+}
+
+void switch_off_domain(int domain)
+{
+    *(pm_state_ptr + domain) = off;
+}
+
 void switch_off()
 {
     *(pm_state_ptr + host_offset) = off;
@@ -1,12 +1,7 @@
 #include "../pm_addr.h"
+#include <stdint.h>
 #include "pmsis.h"
 
-#define pm_state 0x20004000
-#define pm_voltage 0x20005000
-#define pm_config_delay_state 0x20007000
-#define pm_report 0x20006000
-#define pm_config_delay_voltage 0x20008000
-
 //define voltage delays configurations
 #define delay_on_idle 400000000
 #define delay_idle_on 400000000
@@ -38,6 +33,13 @@ void capture_start();
  */
 void capture_stop();
 
+/**
+ * @brief Signal a marker to the launcher, e.g. where it forks its variants.
+ *
+ * @param id Identifier of the marker, reported by the launcher.
+ */
+void marker(int id);
+
 /**
  * @brief Get the captured power consumption of the system.
  * 
@@ -45,6 +47,15 @@ void capture_stop();
  */
 double get_power_consumption();
 
+/**
+ * @brief Read an activity counter of a domain.
+ *
+ * @param domain Offset of the domain, e.g. sensor1_offset.
+ * @param counter Offset of the counter, e.g. activity_requests.
+ * @return The value of the counter since the start of the simulation.
+ */
+uint64_t get_activity(int domain, int counter);
+
 /**
  * @brief Transition the host from run state to sleep state.
  */
@@ -55,6 +66,20 @@ void run_to_sleep();
  */
 void switch_on();
 
+/**
+ * @brief Set the state of a domain to on, powering its parents first.
+ *
+ * @param domain Offset of the domain, e.g. sensor1_offset.
+ */
+void switch_on_domain(int domain);
+
+/**
+ * @brief Set the state of a domain to off, switching its children off first.
+ *
+ * @param domain Offset of the domain, e.g. cluster_offset.
+ */
+void switch_off_domain(int domain);
+
 /**
  * @brief Set the state of host to off.
  */
@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "../pm_addr.h"
+#include "pmsis.h"
+#include "pm_functions.h"
+
+// number of writes issued to each PowerManager window, 0 for the baseline of
+// bench_pm.py
+#ifndef NB_WRITES
+#define NB_WRITES 100000
+#endif
+
+int main()
+{
+    volatile int *pm_config_delay_states_ptr = (volatile int *)pm_config_delay_state;
+    volatile int *pm_config_delay_voltage_ptr = (volatile int *)pm_config_delay_voltage;
+
+    switch_on();
+    printf("Start PM MMIO benchmark\n");
+    for (int i = 0; i < NB_WRITES; i++)
+    {
+        // configuration writes only go through the PM handlers, they do not
+        // start any transition
+        *(pm_config_delay_states_ptr + sensor1_config_offset + latency_offset(on, off)) = 1000 + (i & 0xff);
+        *(pm_config_delay_voltage_ptr) = 1000;
+    }
+    printf("Done %d PM writes\n", 2 * NB_WRITES);
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "../pm_addr.h"
+#include "../sensor_regs.h"
+#include "pmsis.h"
+#include "pm_functions.h"
+
+#define sensor1 0x20000000
+// event line of the fabric controller raised by sensor1, see my_system.py
+#define sensor1_irq 22
+// samples drained at each wake-up
+#define BATCH 32
+
+// filled by the sensor with one write at each watermark
+static uint32_t samples[BATCH];
+
+int main()
+{
+    volatile uint32_t *sensor = (volatile uint32_t *)sensor1;
+
+    switch_on();
+    // the sensor rejects accesses while it is off
+    switch_on_domain(sensor1_offset);
+    capture_start();
+
+    // the sensor samples every 1000 cycles on its own, and pushes each batch
+    // of BATCH samples to the L2 in one burst
+    hal_itc_enable_set(1 << sensor1_irq);
+    sensor[sensor_period / 4] = 1000;
+    sensor[sensor_watermark / 4] = BATCH;
+    sensor[sensor_dma_addr / 4] = (uint32_t)samples;
+    sensor[sensor_ctrl / 4] = sensor_ctrl_sampling;
+
+    for (int j = 0; j < 10; j++)
+    {
+        // sleep in wfi until the batch is in memory
+        run_to_idle();
+        hal_itc_wait_for_event_noirq(1 << sensor1_irq);
+        idle_to_run();
+
+        uint32_t sum = 0;
+        for (int i = 0; i < BATCH; i++)
+        {
+            sum += samples[i] & 0xff;
+        }
+        // the buffer is free again, the sensor can push the next batch
+        sensor[sensor_status / 4] = sensor_status_dma;
+        printf("Batch %d: mean %d\n", j, sum / BATCH);
+    }
+
+    sensor[sensor_ctrl / 4] = 0;
+    capture_stop();
+    printf("Average consumption: %f\n", get_power_consumption());
+    return 0;
+}
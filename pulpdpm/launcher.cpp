@@ -1,12 +1,122 @@
+#include <cstdlib>
 #include <cstring>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <gv/gvsoc.hpp>
 #include <vp/launcher.hpp>
+#include "pm_channel.h"
+
+
+// base addresses of the PowerManager windows, as seen from the core
+#define PM_STATE 0x20004000
+#define PM_VOLTAGE 0x20005000
+#define PM_REPORT 0x20006000
+#define PM_CONFIG_DELAY_STATE 0x20007000
+#define PM_CONFIG_DELAY_VOLTAGE 0x20008000
+// words of the delay configuration window of each domain
+#define PM_CONFIG_WINDOW_WORDS 64
+
+
+// Request forwarded to the PowerManager on behalf of an access of the core,
+// which is only completed once the PowerManager replied. Requests injected by
+// the launcher itself have no original request.
+class PmRequest : public gv::Io_request
+{
+public:
+    gv::Io_request *orig;
+    uint32_t value;
+};
+
+
+// Register write applied to the PowerManager before the job starts, or when
+// the firmware reaches the marker given by --override-marker. The examples
+// write some registers themselves during their setup, which overwrites the
+// overrides applied at the start: switch_on() writes the host voltage and
+// state, config_state_delays() the 4 legacy delays of the host. Some also
+// write them in their loop: the host voltage and the voltage delay in
+// run_to_idle(), idle_to_run(), run_to_sleep() and sleep_to_run(), the host
+// voltage and state in switch_on() and switch_off().
+typedef struct
+{
+    uint64_t addr;
+    uint32_t value;
+} Override;
+
+
+// One simulation of a batch, described by a line of the job list:
+//   <name> <config path> [<addr>=<value> ...]
+// The binary is the one the configuration was prepared with.
+typedef struct
+{
+    std::string name;
+    std::string config_path;
+    std::vector<Override> overrides;
+} Job;
+
+
+// Parse an override given as <addr>=<value>, returns false if it is invalid
+static bool parse_override(std::string field, Override &o)
+{
+    size_t pos = field.find('=');
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    o.addr = strtoull(field.substr(0, pos).c_str(), NULL, 0);
+    o.value = (uint32_t)strtoul(field.substr(pos + 1).c_str(), NULL, 0);
+    return true;
+}
+
+
+// Register write received on the control pipe, applied to the PowerManager
+// when the simulation reaches time (in ps)
+typedef struct
+{
+    int64_t time;
+    uint64_t addr;
+    uint32_t value;
+} PmCommand;
+
+
+struct PmCommandLater
+{
+    bool operator()(const PmCommand &a, const PmCommand &b) const { return a.time > b.time; }
+};
+
+
+// Variant of a simulation forked at the first marker of the firmware,
+// described by a line of the variant list:
+//   <name> [<addr>=<value> ...]
+typedef struct
+{
+    std::string name;
+    std::vector<Override> overrides;
+} Variant;
 
 
 class MyLauncher : public gv::Io_user
 {
 public:
-    int run(std::string config_path);
+    ~MyLauncher();
+
+    int run(std::string config_path, std::vector<Override> &overrides);
+    int simulate(gv::GvsocLauncher *gvsoc, gv::Api_mode api_mode, std::string config_path, std::vector<Override> &overrides);
+    int run_batch(std::string jobs_path, std::string results_path);
+    int parse_variants(std::string variants_path);
+    void set_override_marker(int64_t id) { this->override_marker = id; }
+    void set_control(std::string control_path, int64_t quantum);
 
     // This gets called when an access from gvsoc side is reaching us
     void access(gv::Io_request *req);
@@ -16,8 +126,44 @@ public:
     void reply(gv::Io_request *req);
 
 private:
+    PmRequest *get_request();
+    void release_request(PmRequest *req);
+    int parse_jobs(std::string jobs_path, std::vector<Job> &jobs);
+    void write_pm(uint64_t addr, uint32_t value);
+    void marker(uint32_t id);
+    void fork_variants(uint32_t id);
+    void load_names(std::string config_path);
+    bool parse_command(std::string line, PmCommand &command);
+    void control_loop();
+    void run_controlled(gv::GvsocLauncher *gvsoc);
+
     gv::Io_binding *axi;
     gv::Io_binding *axi_pm;
+
+    // Variants forked at the first marker, and processes running them. Their
+    // outputs go to variants/<name>/ in the work directory.
+    std::vector<Variant> variants;
+    std::vector<pid_t> children;
+    std::string work_dir;
+
+    // Overrides held until the firmware reaches override_marker, -1 to apply
+    // them at the start
+    int64_t override_marker = -1;
+    std::vector<Override> marker_overrides;
+
+    // Commands read by the control thread from the control pipe, and passed to
+    // the simulation thread without locking
+    std::string control_path;
+    int64_t control_quantum;
+    PmRing<PmCommand> commands;
+    // indexes of the states and domains, read from the generated headers
+    std::map<std::string, int> state_ids;
+    std::map<std::string, int> domain_ids;
+    int nb_states = 0;
+
+    // Requests are recycled, as many of them can be outstanding at the same time
+    std::vector<PmRequest *> free_requests;
+    std::mutex requests_lock;
 };
 
 
@@ -25,6 +171,13 @@ private:
 int main(int argc, char *argv[])
 {
     char *config_path = NULL;
+    char *jobs_path = NULL;
+    std::string results_path = "result/batch.txt";
+    std::vector<Override> overrides;
+    char *variants_path = NULL;
+    char *control_path = NULL;
+    int64_t control_quantum = 1000000;
+    int64_t override_marker = -1;
 
     for (int i=1; i<argc; i++)
     {
@@ -32,73 +185,825 @@ int main(int argc, char *argv[])
         {
             config_path = &argv[i][9];
         }
+        else if (strncmp(argv[i], "--jobs=", 7) == 0)
+        {
+            jobs_path = &argv[i][7];
+        }
+        else if (strncmp(argv[i], "--results=", 10) == 0)
+        {
+            results_path = &argv[i][10];
+        }
+        else if (strncmp(argv[i], "--control=", 10) == 0)
+        {
+            control_path = &argv[i][10];
+        }
+        else if (strncmp(argv[i], "--control-quantum=", 18) == 0)
+        {
+            control_quantum = strtoll(&argv[i][18], NULL, 0);
+        }
+        else if (strncmp(argv[i], "--fork-variants=", 16) == 0)
+        {
+            variants_path = &argv[i][16];
+        }
+        else if (strncmp(argv[i], "--override-marker=", 18) == 0)
+        {
+            override_marker = strtoll(&argv[i][18], NULL, 0);
+        }
+        else if (strncmp(argv[i], "--override=", 11) == 0)
+        {
+            Override o;
+            if (!parse_override(&argv[i][11], o))
+            {
+                fprintf(stderr, "Invalid override %s, expected --override=<addr>=<value>\n", &argv[i][11]);
+                return -1;
+            }
+            overrides.push_back(o);
+        }
+    }
+
+    MyLauncher launcher;
+    launcher.set_override_marker(override_marker);
+
+    if (jobs_path != NULL)
+    {
+        return launcher.run_batch(jobs_path, results_path);
     }
 
     if (config_path == NULL)
     {
-        fprintf(stderr, "No configuration specified, please specify through option --config=<config path>.\n");
+        fprintf(stderr, "No configuration specified, please specify through option --config=<config path> or --jobs=<job list>.\n");
         return -1;
     }
 
-    MyLauncher launcher;
+    if (variants_path != NULL && control_path != NULL)
+    {
+        fprintf(stderr, "Variants can't be forked with --control, its thread would be missing from the variants\n");
+        return -1;
+    }
 
-    return launcher.run(config_path);
+    if (variants_path != NULL && launcher.parse_variants(variants_path))
+    {
+        return -1;
+    }
+
+    if (control_path != NULL)
+    {
+        launcher.set_control(control_path, control_quantum);
+    }
+
+    return launcher.run(config_path, overrides);
 }
 
 
 
-int MyLauncher::run(std::string config_path)
+MyLauncher::~MyLauncher()
 {
+    for (PmRequest *req : this->free_requests)
+    {
+        delete req;
+    }
+}
+
 
-    gv::GvsocConf conf = { .config_path=config_path, .api_mode=gv::Api_mode::Api_mode_sync };
+
+int MyLauncher::run(std::string config_path, std::vector<Override> &overrides)
+{
+    // The simulation runs in its own thread, accesses are forwarded and
+    // replied from the callbacks without blocking it. Variants fork the
+    // process, which only duplicates the calling thread, so they need the
+    // simulation to run in the launcher thread.
+    // Commands are applied between steps of the simulation, which also need
+    // the synchronous mode.
+    gv::Api_mode api_mode = this->variants.empty() && this->control_path.empty() ? gv::Api_mode::Api_mode_async : gv::Api_mode::Api_mode_sync;
+    gv::GvsocConf conf = { .config_path=config_path, .api_mode=api_mode };
+    size_t sep = config_path.rfind('/');
+    this->work_dir = sep == std::string::npos ? "." : config_path.substr(0, sep);
    
     gv::GvsocLauncher *gvsoc = (gv::GvsocLauncher *)gv::gvsoc_new(&conf);
     gvsoc->open();
+    int retval = -1;
     // Get a connection to the main soc AXI. This will allow us to inject accesses
     // and could also be used to received accesses from simulated test
     // to a certain mapping corresponding to the external devices.
     this->axi = gvsoc->io_bind(this, "/host/chip/axi_proxy", "");
+    this->axi_pm = this->axi != NULL ? gvsoc->io_bind(this, "/axi_pm", "") : NULL;
     if (this->axi == NULL)
     {
         fprintf(stderr, "Couldn't find AXI proxy\n");
-        return -1;
     }
-
-      this->axi_pm = gvsoc->io_bind(this, "/axi_pm", "");
-    if (this->axi_pm == NULL)
+    else if (this->axi_pm == NULL)
     {
         fprintf(stderr, "Couldn't find AXI pm proxy\n");
-        return -1;
     }
+    else
+    {
+        retval = this->simulate(gvsoc, api_mode, config_path, overrides);
+    }
+
+    // Each job of a batch creates its own instance, which is released whatever
+    // the outcome of the job
+    gvsoc->close();
+    delete gvsoc;
+    this->axi = NULL;
+    this->axi_pm = NULL;
+
+    // The process which forked the variants collects them
+    for (unsigned int i = 0; i < this->children.size(); i++)
+    {
+        int status;
+        int variant_retval = -1;
+        if (this->children[i] > 0 && waitpid(this->children[i], &status, 0) > 0 && WIFEXITED(status))
+        {
+            variant_retval = WEXITSTATUS(status);
+        }
+        fprintf(stdout, "Variant %s exited with status %d\n", this->variants[i].name.c_str(), variant_retval);
+        if (variant_retval != 0)
+        {
+            retval = variant_retval;
+        }
+    }
+
+    return retval;
+}
 
+
+
+int MyLauncher::simulate(gv::GvsocLauncher *gvsoc, gv::Api_mode api_mode, std::string config_path, std::vector<Override> &overrides)
+{
     gvsoc->start();
 
+    this->marker_overrides.clear();
+    if (this->override_marker >= 0)
+    {
+        this->marker_overrides = overrides;
+    }
+    else
+    {
+        // in asynchronous mode the engine has its own thread once started, the
+        // writes are injected under its lock
+        if (api_mode == gv::Api_mode::Api_mode_async)
+        {
+            gvsoc->lock();
+        }
+        for (Override &o : overrides)
+        {
+            this->write_pm(o.addr, o.value);
+        }
+        if (api_mode == gv::Api_mode::Api_mode_async)
+        {
+            gvsoc->unlock();
+        }
+    }
+
     // Run
-    gvsoc->run();
+    if (this->control_path.empty())
+    {
+        gvsoc->run();
+    }
+    else
+    {
+        this->load_names(config_path);
+        this->run_controlled(gvsoc);
+    }
     
 
     // Wait for simulation termination and exit code returned by simulated test
     int retval = gvsoc->join();
 
-    gvsoc->stop();
-    gvsoc->close();
+    if (!this->marker_overrides.empty())
+    {
+        fprintf(stderr, "Marker %ld never reached, the overrides were not applied\n", this->override_marker);
+        retval = -1;
+    }
 
+    gvsoc->stop();
     return retval;
 }
 
 
 
+void MyLauncher::write_pm(uint64_t addr, uint32_t value)
+{
+    PmRequest *pm_req = this->get_request();
+    pm_req->value = value;
+    pm_req->data = (uint8_t *)&pm_req->value;
+    pm_req->size = sizeof(pm_req->value);
+    pm_req->type = gv::Io_request_write;
+    pm_req->addr = addr;
+    pm_req->orig = NULL;
+    this->axi_pm->access(pm_req);
+}
+
+
+
+void MyLauncher::set_control(std::string control_path, int64_t quantum)
+{
+    this->control_path = control_path;
+    this->control_quantum = quantum;
+}
+
+
+
+// The generated pm_states.h and pm_domains.h are in the work directory, next
+// to the configuration
+void MyLauncher::load_names(std::string config_path)
+{
+    size_t sep = config_path.rfind('/');
+    std::string dir = sep == std::string::npos ? "." : config_path.substr(0, sep);
+
+    for (std::string header : { "pm_states.h", "pm_domains.h" })
+    {
+        std::ifstream file(dir + "/" + header);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            std::string define, name, text;
+            if (!(fields >> define >> name >> text) || define != "#define")
+            {
+                continue;
+            }
+            // the states are written in hexadecimal and the offsets in decimal
+            char *end;
+            int value = strtol(text.c_str(), &end, 0);
+            if (*end != '\0')
+            {
+                continue;
+            }
+
+            if (name == "nb_power_states")
+            {
+                this->nb_states = value;
+            }
+            else if (header == "pm_states.h")
+            {
+                this->state_ids[name] = value;
+            }
+            else if (name.size() > 7 && name.compare(name.size() - 7, 7, "_offset") == 0 &&
+                     name.find("_config_offset") == std::string::npos)
+            {
+                this->domain_ids[name.substr(0, name.size() - 7)] = value;
+            }
+        }
+    }
+}
+
+
+
+// Commands are given one per line, as:
+//   <time in ps|now> state <domain> <state>
+//   <time in ps|now> voltage <domain> <voltage>
+//   <time in ps|now> voltage_delay <delay in ps>
+//   <time in ps|now> delay <domain> <from state> <to state> <latency in ps>
+//   <time in ps|now> capture start|stop
+//   <time in ps|now> write <addr> <value>
+// Domains and states are given by name or by index.
+bool MyLauncher::parse_command(std::string line, PmCommand &command)
+{
+    std::istringstream fields(line);
+    std::string time, name;
+    if (!(fields >> time >> name))
+    {
+        return false;
+    }
+    command.time = time == "now" ? 0 : strtoll(time.c_str(), NULL, 0);
+
+    auto id = [](std::map<std::string, int> &ids, std::string name) {
+        auto it = ids.find(name);
+        return it != ids.end() ? it->second : (int)strtol(name.c_str(), NULL, 0);
+    };
+
+    std::string a, b, c, d;
+    if (name == "state" && fields >> a >> b)
+    {
+        command.addr = PM_STATE + id(this->domain_ids, a) * 4;
+        command.value = id(this->state_ids, b);
+    }
+    else if (name == "voltage" && fields >> a >> b)
+    {
+        float voltage = strtof(b.c_str(), NULL);
+        command.addr = PM_VOLTAGE + id(this->domain_ids, a) * 4;
+        memcpy(&command.value, &voltage, sizeof(voltage));
+    }
+    else if (name == "voltage_delay" && fields >> a)
+    {
+        command.addr = PM_CONFIG_DELAY_VOLTAGE;
+        command.value = strtoul(a.c_str(), NULL, 0);
+    }
+    else if (name == "delay" && fields >> a >> b >> c >> d)
+    {
+        int reg = 4 + id(this->state_ids, b) * this->nb_states + id(this->state_ids, c);
+        command.addr = PM_CONFIG_DELAY_STATE + (id(this->domain_ids, a) * PM_CONFIG_WINDOW_WORDS + reg) * 4;
+        command.value = strtoul(d.c_str(), NULL, 0);
+    }
+    else if (name == "capture" && fields >> a && (a == "start" || a == "stop"))
+    {
+        command.addr = PM_REPORT;
+        command.value = a == "start";
+    }
+    else if (name == "write" && fields >> a >> b)
+    {
+        command.addr = strtoull(a.c_str(), NULL, 0);
+        command.value = strtoul(b.c_str(), NULL, 0);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+
+// Reads the control pipe, which is opened again each time its writer closes it,
+// or the control file once
+void MyLauncher::control_loop()
+{
+    struct stat info;
+    bool is_fifo = stat(this->control_path.c_str(), &info) == 0 && S_ISFIFO(info.st_mode);
+
+    do
+    {
+        std::ifstream control(this->control_path);
+        std::string line;
+        while (std::getline(control, line))
+        {
+            PmCommand command;
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            if (!this->parse_command(line, command))
+            {
+                fprintf(stderr, "Invalid command: %s\n", line.c_str());
+                continue;
+            }
+            while (!this->commands.push(command))
+            {
+                sched_yield();
+            }
+        }
+    } while (is_fifo);
+}
+
+
+
+// The simulation advances by steps of at most control_quantum ps, between which
+// the received commands are applied once their time is reached
+void MyLauncher::run_controlled(gv::GvsocLauncher *gvsoc)
+{
+    // the control thread is left blocked on the pipe when the simulation ends
+    std::thread control(&MyLauncher::control_loop, this);
+    control.detach();
+
+    std::priority_queue<PmCommand, std::vector<PmCommand>, PmCommandLater> pending;
+    int64_t time = 0;
+
+    // a negative time means the simulation is over
+    while (time >= 0)
+    {
+        PmCommand command;
+        while (this->commands.pop(command))
+        {
+            pending.push(command);
+        }
+
+        while (!pending.empty() && pending.top().time <= time)
+        {
+            this->write_pm(pending.top().addr, pending.top().value);
+            pending.pop();
+        }
+
+        int64_t next_time = time + this->control_quantum;
+        if (!pending.empty() && pending.top().time < next_time)
+        {
+            next_time = pending.top().time;
+        }
+        time = gvsoc->step_until(next_time);
+    }
+}
+
+
+
+int MyLauncher::parse_variants(std::string variants_path)
+{
+    std::ifstream file(variants_path);
+    if (!file)
+    {
+        fprintf(stderr, "Couldn't open variant list %s\n", variants_path.c_str());
+        return -1;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        Variant variant;
+        if (!(fields >> variant.name) || variant.name[0] == '#')
+        {
+            continue;
+        }
+
+        std::string field;
+        while (fields >> field)
+        {
+            Override o;
+            if (!parse_override(field, o))
+            {
+                fprintf(stderr, "Invalid override %s in variant %s, expected <addr>=<value>\n", field.c_str(), variant.name.c_str());
+                return -1;
+            }
+            variant.overrides.push_back(o);
+        }
+
+        this->variants.push_back(variant);
+    }
+
+    return 0;
+}
+
+
+
+// Markers are written by the firmware to the PowerManager, which forwards them.
+// They are received from the engine, so the overrides are written without
+// taking its lock, before forking so that the variants inherit them.
+void MyLauncher::marker(uint32_t id)
+{
+    if ((int64_t)id == this->override_marker && !this->marker_overrides.empty())
+    {
+        fprintf(stdout, "Marker %d reached, applying %zu overrides\n", id, this->marker_overrides.size());
+        for (Override &o : this->marker_overrides)
+        {
+            this->write_pm(o.addr, o.value);
+        }
+        this->marker_overrides.clear();
+    }
+
+    this->fork_variants(id);
+}
+
+
+
+// Output file of the simulation, which a variant gets its own copy of
+typedef struct
+{
+    int fd;
+    std::string path;
+    off_t size;
+} OutputFile;
+
+
+
+// Regular files open for writing, other than the standard streams, are the VCD
+// and trace files of the simulation
+static std::vector<OutputFile> output_files()
+{
+    std::vector<OutputFile> files;
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == NULL)
+    {
+        return files;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        int fd = atoi(entry->d_name);
+        struct stat info;
+        char path[4096];
+        std::string link = std::string("/proc/self/fd/") + entry->d_name;
+        ssize_t len = readlink(link.c_str(), path, sizeof(path) - 1);
+        int flags = fcntl(fd, F_GETFL);
+        if (fd <= STDERR_FILENO || fd == dirfd(dir) || len <= 0 || flags < 0 || (flags & O_ACCMODE) == O_RDONLY ||
+            fstat(fd, &info) < 0 || !S_ISREG(info.st_mode))
+        {
+            continue;
+        }
+        path[len] = 0;
+        if (strncmp(path, "/dev/", 5) == 0)
+        {
+            continue;
+        }
+        files.push_back({ fd, path, lseek(fd, 0, SEEK_CUR) });
+    }
+    closedir(dir);
+    return files;
+}
+
+
+
+// Replaces an output file with a copy of what the simulation wrote to it before
+// the fork, so that the variant appends to its own file
+static void redirect_output(OutputFile &file, std::string dir)
+{
+    size_t sep = file.path.rfind('/');
+    std::string path = dir + "/" + (sep == std::string::npos ? file.path : file.path.substr(sep + 1));
+    int copy = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (copy < 0)
+    {
+        fprintf(stderr, "Couldn't create %s\n", path.c_str());
+        return;
+    }
+
+    char buffer[65536];
+    off_t offset = 0;
+    while (offset < file.size)
+    {
+        ssize_t len = pread(file.fd, buffer, std::min((off_t)sizeof(buffer), file.size - offset), offset);
+        if (len <= 0 || write(copy, buffer, len) != len)
+        {
+            break;
+        }
+        offset += len;
+    }
+
+    dup2(copy, file.fd);
+    close(copy);
+}
+
+
+
+static int nb_threads()
+{
+    int count = 0;
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == NULL)
+    {
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+
+
+// This is not a checkpoint which can be saved and restored later: the
+// simulation is forked while it is stopped in the first marker access, and
+// each child continues it with the overrides of its variant, while the parent
+// carries on with the original parameters. All the variants are thus given
+// when the run starts. Each child writes its log, its VCD and its traces to
+// variants/<name>/ in the work directory, starting from a copy of what the
+// simulation wrote before the fork.
+void MyLauncher::fork_variants(uint32_t id)
+{
+    if (this->variants.empty() || !this->children.empty())
+    {
+        return;
+    }
+
+    // fork only duplicates the calling thread, the variants would run without
+    // the other ones
+    int threads = nb_threads();
+    if (threads != 1)
+    {
+        fprintf(stderr, "Marker %d reached with %d threads running, not forking the variants\n", id, threads);
+        this->variants.clear();
+        return;
+    }
+
+    fprintf(stdout, "Marker %d reached, forking %zu variants\n", id, this->variants.size());
+
+    // buffered output would otherwise be written by the parent and by each child
+    fflush(NULL);
+    std::vector<OutputFile> files = output_files();
+
+    for (Variant &variant : this->variants)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            fprintf(stderr, "Couldn't fork variant %s\n", variant.name.c_str());
+            this->children.push_back(-1);
+            continue;
+        }
+
+        if (pid == 0)
+        {
+            std::string dir = this->work_dir + "/variants/" + variant.name;
+            mkdir((this->work_dir + "/variants").c_str(), 0755);
+            mkdir(dir.c_str(), 0755);
+            for (OutputFile &file : files)
+            {
+                redirect_output(file, dir);
+            }
+
+            std::string log_path = dir + "/sim.log";
+            int log = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (log >= 0)
+            {
+                dup2(log, STDOUT_FILENO);
+                dup2(log, STDERR_FILENO);
+                close(log);
+            }
+
+            for (Override &o : variant.overrides)
+            {
+                this->write_pm(o.addr, o.value);
+            }
+
+            // the child is a plain run from now on
+            this->variants.clear();
+            this->children.clear();
+            return;
+        }
+
+        this->children.push_back(pid);
+    }
+}
+
+
+
+int MyLauncher::parse_jobs(std::string jobs_path, std::vector<Job> &jobs)
+{
+    std::ifstream file(jobs_path);
+    if (!file)
+    {
+        fprintf(stderr, "Couldn't open job list %s\n", jobs_path.c_str());
+        return -1;
+    }
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        Job job;
+        if (!(fields >> job.name) || job.name[0] == '#')
+        {
+            continue;
+        }
+        if (!(fields >> job.config_path))
+        {
+            fprintf(stderr, "Job %s has no configuration\n", job.name.c_str());
+            return -1;
+        }
+
+        std::string field;
+        while (fields >> field)
+        {
+            Override o;
+            if (!parse_override(field, o))
+            {
+                fprintf(stderr, "Invalid override %s in job %s, expected <addr>=<value>\n", field.c_str(), job.name.c_str());
+                return -1;
+            }
+            job.overrides.push_back(o);
+        }
+
+        jobs.push_back(job);
+    }
+
+    return 0;
+}
+
+
+
+int MyLauncher::run_batch(std::string jobs_path, std::string results_path)
+{
+    std::vector<Job> jobs;
+    if (this->parse_jobs(jobs_path, jobs))
+    {
+        return -1;
+    }
+
+    FILE *results = fopen(results_path.c_str(), "w");
+    if (results == NULL)
+    {
+        fprintf(stderr, "Couldn't open results file %s\n", results_path.c_str());
+        return -1;
+    }
+
+    // logs of the jobs are written next to the results file
+    std::string log_dir = ".";
+    size_t sep = results_path.rfind('/');
+    if (sep != std::string::npos)
+    {
+        log_dir = results_path.substr(0, sep);
+    }
+
+    int status = 0;
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+
+    // All jobs run in this process, so the GVSoC library and the component
+    // modules are only loaded once. The output of each job, which includes the
+    // power measurements of the PowerManager, goes to its own log.
+    for (Job &job : jobs)
+    {
+        std::string log_path = log_dir + "/" + job.name + ".log";
+        int log = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (log < 0)
+        {
+            fprintf(stderr, "Couldn't open log %s\n", log_path.c_str());
+            status = -1;
+            continue;
+        }
+
+        fprintf(stdout, "Running job %s\n", job.name.c_str());
+        fflush(stdout);
+        fflush(stderr);
+        dup2(log, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+        close(log);
+
+        auto start = std::chrono::steady_clock::now();
+        int retval = this->run(job.config_path, job.overrides);
+        std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+        fflush(stdout);
+        fflush(stderr);
+        dup2(saved_stdout, STDOUT_FILENO);
+        dup2(saved_stderr, STDERR_FILENO);
+
+        if (retval != 0)
+        {
+            status = retval;
+        }
+
+        fprintf(results, "%s status=%d wall=%f\n", job.name.c_str(), retval, wall.count());
+
+        std::ifstream job_log(log_path);
+        std::string line;
+        while (std::getline(job_log, line))
+        {
+            long time;
+            double power;
+            if (sscanf(line.c_str(), "@power.measure_%ld@%lf@", &time, &power) == 2)
+            {
+                fprintf(results, "    measure %ld %f\n", time, power);
+            }
+            else if (line.find("Average consumption:") != std::string::npos)
+            {
+                fprintf(results, "    %s\n", line.c_str());
+            }
+        }
+        fflush(results);
+    }
+
+    close(saved_stdout);
+    close(saved_stderr);
+    fclose(results);
+
+    return status;
+}
+
+
+
+PmRequest *MyLauncher::get_request()
+{
+    std::lock_guard<std::mutex> lock(this->requests_lock);
+
+    if (this->free_requests.empty())
+    {
+        return new PmRequest();
+    }
+
+    PmRequest *req = this->free_requests.back();
+    this->free_requests.pop_back();
+    return req;
+}
+
+
+
+void MyLauncher::release_request(PmRequest *req)
+{
+    std::lock_guard<std::mutex> lock(this->requests_lock);
+    this->free_requests.push_back(req);
+}
+
+
+
 void MyLauncher::access(gv::Io_request *req)
 {
     // printf("Received request (is_read: %d, addr: 0x%lx, size: 0x%lx)\n", req->type == gv::Io_request_read, req->addr, req->size);
 
-    if (req->type == gv::Io_request_read)
+    // Marker sent by the PowerManager, the core never accesses address 0
+    // through the external AXI
+    if (req->addr == 0)
     {
-        memset(req->data, req->addr, req->size);
+        this->marker(*(uint32_t *)req->data);
+        this->axi_pm->reply(req);
+        return;
     }
 
-    this->axi->reply(req);
-    this->axi_pm->access(req);
+    // The PowerManager works directly on the data of the original request, so
+    // that reads return its registers
+    PmRequest *pm_req = this->get_request();
+    pm_req->data = req->data;
+    pm_req->size = req->size;
+    pm_req->type = req->type;
+    pm_req->addr = req->addr;
+    pm_req->orig = req;
+
+    this->axi_pm->access(pm_req);
 }
 
 
@@ -111,5 +1016,17 @@ void MyLauncher::grant(gv::Io_request *req)
 
 void MyLauncher::reply(gv::Io_request *req)
 {
-}
+    PmRequest *pm_req = (PmRequest *)req;
+    gv::Io_request *orig = pm_req->orig;
 
+    if (orig != NULL)
+    {
+        orig->retval = pm_req->retval;
+    }
+    this->release_request(pm_req);
+
+    if (orig != NULL)
+    {
+        this->axi->reply(orig);
+    }
+}
@@ -1,77 +1,494 @@
 #include <vp/vp.hpp>
 #include <vp/signal.hpp>
 #include <vp/itf/io.hpp>
+#include <vp/itf/wire.hpp>
 #include <stdio.h>
+#include <deque>
+#include <queue>
+#include <random>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sensor_regs.h"
+#include "pm_activity.h"
 
 using namespace vp;
 
+// Power modes of the sensor, selected by its supply and its sampling rate
+enum sensor_mode
+{
+    SENSOR_OFF,
+    SENSOR_STANDBY,
+    SENSOR_LOW_RATE,
+    SENSOR_HIGH_RATE,
+    SENSOR_NB_MODES
+};
+
+static const char *sensor_mode_names[SENSOR_NB_MODES] = {"off", "standby", "low_rate", "high_rate"};
+
+// One record of a sensor trace file, samples are sorted by timestamp
+typedef struct
+{
+    int64_t time;
+    uint32_t value;
+    uint32_t reserved;
+} sensor_sample;
+
 class MySensor : public Component
 {
 private:
     IoSlave input_itf;
     IoSlave power_req_itf;
-    vp::IoReq *pending_req;
+    // read being converted, and reads waiting for the converter
+    vp::IoReq *pending_req = NULL;
+    std::queue<vp::IoReq *> waiting_reqs;
     vp::ClockEvent event;
+    // autonomous sampling into the FIFO
+    vp::ClockEvent sample_event;
+    std::deque<uint32_t> fifo;
+    unsigned int fifo_depth;
+    uint32_t ctrl = 0;
+    uint32_t period = 1000;
+    uint32_t watermark;
+    uint32_t status = 0;
+    vp::WireMaster<bool> irq_itf;
+    bool irq_level = false;
+    // push of the samples to memory when the watermark is reached
+    IoMaster dma_itf;
+    vp::IoReq dma_req;
+    std::vector<uint32_t> dma_buffer;
+    uint32_t dma_addr = 0;
+    bool dma_pending = false;
+    // counters sampled by the PowerManager
+    vp::WireMaster<pm_activity *> activity_itf;
+    pm_activity activity = {};
     vp::PowerSource access_power;
     vp::PowerSource background_power;
     vp::Trace trace;
      vp::Signal<uint32_t> vcd_value;
 
+    // power drawn in each mode, the off mode draws nothing
+    vp::PowerSource mode_power[SENSOR_NB_MODES];
+    int mode = SENSOR_OFF;
+    vp::Signal<int> vcd_mode;
+    // mode reported to the PowerManager for its power estimate
+    vp::WireMaster<int> mode_itf;
+    // sampling periods below this number of cycles use the high rate mode
+    uint32_t high_rate_period;
+    // cycles needed to leave the standby mode
+    int64_t standby_wake_cycles;
+    // accesses to an off sensor fail if true, and otherwise are only delayed by
+    // off_access_latency cycles, the sensor staying off
+    bool off_access_error;
+    int64_t off_access_latency;
+
+    // samples of the trace file, NULL if the data comes from the PRNG
+    sensor_sample *samples = NULL;
+    size_t nb_samples = 0;
+    bool loop;
+    // index of the sample returned by the last read, time only moves forward
+    size_t cursor = 0;
+    std::mt19937 prng;
+
+    // conversion time in cycles, longer for the first one after a power-up
+    int64_t conversion_cycles;
+    int64_t wake_conversion_cycles;
+    bool woken_up = false;
+    vp::PowerSupplyState supply = vp::PowerSupplyState::OFF;
+
+    uint32_t sample();
+    void start_conversion(vp::IoReq *req);
+    void update_irq();
+    void sync_irq();
+    void start_dma();
+    void update_mode();
+    IoReqStatus handle_fifo_read(IoReq *req);
+    IoReqStatus handle_reg(IoReq *req);
+
 public:
     MySensor(ComponentConf &config);
+    void reset(bool active) override;
     void power_supply_set(vp::PowerSupplyState state);
     static IoReqStatus handle_req(Block *__this, IoReq *req);
     static void handle_event(vp::Block *__this, vp::ClockEvent *event);
+    static void handle_sample(vp::Block *__this, vp::ClockEvent *event);
+    static void dma_grant(vp::Block *__this, vp::IoReq *req);
+    static void dma_resp(vp::Block *__this, vp::IoReq *req);
 };
 
-MySensor::MySensor(ComponentConf &config) : Component(config), event(this, MySensor::handle_event), vcd_value(*this, "status", 32)
+MySensor::MySensor(ComponentConf &config) : Component(config), event(this, MySensor::handle_event), sample_event(this, MySensor::handle_sample), vcd_value(*this, "status", 32), vcd_mode(*this, "mode", 2)
 {
     this->input_itf.set_req_meth(&MySensor::handle_req);
     this->new_slave_port("input", &this->input_itf);
+    this->new_master_port("irq", &this->irq_itf);
+    this->dma_itf.set_resp_meth(&MySensor::dma_resp);
+    this->dma_itf.set_grant_meth(&MySensor::dma_grant);
+    this->new_master_port("dma", &this->dma_itf);
+    this->new_master_port("activity", &this->activity_itf);
+    this->new_master_port("mode", &this->mode_itf);
     
     this->traces.new_trace("trace", &this->trace);
 
 
     this->power.new_power_source("leakage", &background_power, this->get_js_config()->get("**/background_power"));
     this->power.new_power_source("access", &access_power, this->get_js_config()->get("**/access_power"));
-    
-    this->background_power.leakage_power_start();
+    for (int mode = SENSOR_STANDBY; mode < SENSOR_NB_MODES; mode++)
+    {
+        std::string name = sensor_mode_names[mode];
+        this->power.new_power_source(name, &this->mode_power[mode], this->get_js_config()->get("**/modes/" + name + "/power"));
+    }
+
+    js::Config *modes_config = this->get_js_config()->get("modes");
+    this->high_rate_period = modes_config->get_child_int("high_rate_period");
+    this->standby_wake_cycles = modes_config->get_child_int("standby/wake_cycles");
+    this->off_access_error = modes_config->get_child_str("off_access") == "error";
+    this->off_access_latency = modes_config->get_child_int("off/latency_cycles");
+
+    // Data comes from the trace file if one is given, and otherwise from a
+    // PRNG seeded per instance, so that runs are reproducible
+    js::Config *data_config = this->get_js_config()->get("data");
+    std::string trace_path = data_config->get_child_str("trace");
+    this->loop = data_config->get_child_str("mode") == "loop";
+    this->prng.seed(data_config->get_child_int("seed"));
+
+    this->conversion_cycles = this->get_js_config()->get_child_int("conversion_cycles");
+    this->wake_conversion_cycles = this->get_js_config()->get_child_int("wake_conversion_cycles");
+    this->fifo_depth = this->get_js_config()->get_child_int("fifo_depth");
+    this->watermark = this->fifo_depth / 2;
+
+    if (trace_path != "")
+    {
+        int fd = open(trace_path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) < 0)
+            this->trace.fatal("Couldn't open sensor trace %s\n", trace_path.c_str());
+        this->nb_samples = info.st_size / sizeof(sensor_sample);
+        if (this->nb_samples == 0)
+            this->trace.fatal("Sensor trace %s is empty\n", trace_path.c_str());
+        this->samples = (sensor_sample *)mmap(NULL, this->nb_samples * sizeof(sensor_sample), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (this->samples == MAP_FAILED)
+            this->trace.fatal("Couldn't map sensor trace %s\n", trace_path.c_str());
+    }
 }
 
+// Returns the sample of the trace valid at the current simulated time. In loop
+// mode the trace restarts after its last sample, held for the same time as the
+// previous one, and otherwise the last sample is held forever.
+uint32_t MySensor::sample()
+{
+    if (this->samples == NULL)
+        return this->prng();
+
+    int64_t time = this->time.get_time();
+    if (this->loop && this->nb_samples > 1)
+    {
+        sensor_sample &last = this->samples[this->nb_samples - 1];
+        int64_t period = 2 * last.time - this->samples[this->nb_samples - 2].time;
+        if (period > 0)
+        {
+            time %= period;
+            if (time < this->samples[this->cursor].time)
+                this->cursor = 0;
+        }
+    }
+
+    while (this->cursor + 1 < this->nb_samples && this->samples[this->cursor + 1].time <= time)
+        this->cursor++;
+
+    return this->samples[this->cursor].value;
+}
+
+// Reads are answered asynchronously once the conversion is done, so that the
+// initiator can do something else in the meantime. Reads received during a
+// conversion are served in order after it.
 IoReqStatus MySensor::handle_req(Block *__this, IoReq *req)
 {
     MySensor *_this = (MySensor *)__this;
+
+    if (_this->mode == SENSOR_OFF)
+    {
+        if (_this->off_access_error)
+        {
+            _this->trace.msg(vp::TraceLevel::DEBUG, "Rejecting access at 0x%lx, the sensor is off\n", req->get_addr());
+            return IO_REQ_INVALID;
+        }
+        req->inc_latency(_this->off_access_latency);
+    }
+
     _this->access_power.account_energy_quantum();
-    if (!req->get_is_write() && req->get_addr() == 0 && req->get_size() == 4)
+    _this->activity.requests++;
+    _this->activity.bytes += req->get_size();
+    if (!req->get_is_write() && req->get_addr() == sensor_data && req->get_size() == 4)
     {
-        *(uint32_t *)req->get_data() = rand();
-        req->inc_latency(2000);
-        return vp::IO_REQ_OK;
+        if (_this->pending_req == NULL)
+            _this->start_conversion(req);
+        else
+            _this->waiting_reqs.push(req);
+        return vp::IO_REQ_PENDING;
     }
+    else if (!req->get_is_write() && req->get_addr() >= sensor_fifo)
+        return _this->handle_fifo_read(req);
+    else if (req->get_size() == 4)
+        return _this->handle_reg(req);
     return IO_REQ_OK;
 }
 
-void MySensor::handle_event(vp::Block *__this, vp::ClockEvent *event)
+// A read of any size pops one sample per word, so that a DMA can drain the
+// FIFO with a single burst. Words beyond the FIFO level read as 0.
+IoReqStatus MySensor::handle_fifo_read(IoReq *req)
 {
-    MySensor *_this = (MySensor *)__this;
+    uint32_t *data = (uint32_t *)req->get_data();
+    for (unsigned int i = 0; i < req->get_size() / 4; i++)
+    {
+        if (this->fifo.empty())
+            data[i] = 0;
+        else
+        {
+            data[i] = this->fifo.front();
+            this->fifo.pop_front();
+        }
+    }
+    this->update_irq();
+    return IO_REQ_OK;
+}
+
+IoReqStatus MySensor::handle_reg(IoReq *req)
+{
+    uint32_t *data = (uint32_t *)req->get_data();
 
-    *(uint32_t *)_this->pending_req->get_data() = rand();
-    _this->pending_req->get_resp_port()->resp(_this->pending_req);
+    if (req->get_is_write())
+    {
+        switch (req->get_addr())
+        {
+        case sensor_ctrl:
+            this->ctrl = *data;
+            this->update_mode();
+            break;
+        case sensor_period:
+            this->period = *data > 0 ? *data : 1;
+            this->update_mode();
+            break;
+        case sensor_watermark:
+            this->watermark = *data;
+            break;
+        case sensor_status:
+            this->status &= ~*data;
+            break;
+        case sensor_dma_addr:
+            this->dma_addr = *data;
+            break;
+        }
+        this->update_irq();
+    }
+    else
+    {
+        switch (req->get_addr())
+        {
+        case sensor_ctrl:
+            *data = this->ctrl;
+            break;
+        case sensor_period:
+            *data = this->period;
+            break;
+        case sensor_watermark:
+            *data = this->watermark;
+            break;
+        case sensor_level:
+            *data = this->fifo.size();
+            break;
+        case sensor_status:
+            *data = this->status;
+            break;
+        case sensor_dma_addr:
+            *data = this->dma_addr;
+            break;
+        default:
+            *data = 0;
+        }
+    }
+    return IO_REQ_OK;
 }
 
-extern "C" Component *gv_new(ComponentConf &config)
+// The interrupt stays raised while the FIFO level is above the watermark and
+// the status bit is not cleared. With a DMA address, the samples are pushed to
+// memory first, and the interrupt then tells that the batch is there. The
+// level is first updated for the cleared bits, so that a bit set again right
+// away still gives a new edge to the interrupt controller.
+void MySensor::update_irq()
 {
-    return new MySensor(config);
+    this->sync_irq();
+    if (this->watermark > 0 && this->fifo.size() >= this->watermark)
+    {
+        if (this->dma_addr != 0 && this->dma_itf.is_bound())
+        {
+            if (!this->dma_pending && !(this->status & sensor_status_dma))
+                this->start_dma();
+        }
+        else
+            this->status |= sensor_status_watermark;
+    }
+    this->sync_irq();
 }
 
-void MySensor::power_supply_set(vp::PowerSupplyState state)
+void MySensor::sync_irq()
+{
+    bool irq_level = (this->status & (sensor_status_watermark | sensor_status_dma)) != 0;
+    if (irq_level != this->irq_level && this->irq_itf.is_bound())
+        this->irq_itf.sync(irq_level);
+    this->irq_level = irq_level;
+}
+
+// The batch is written with a single request, the memory is then free to
+// split it as it needs
+void MySensor::start_dma()
 {
-    if (state == vp::PowerSupplyState::ON)
+    this->dma_buffer.resize(this->watermark);
+    for (unsigned int i = 0; i < this->watermark; i++)
+    {
+        this->dma_buffer[i] = this->fifo.front();
+        this->fifo.pop_front();
+    }
+
+    this->trace.msg(vp::TraceLevel::DEBUG, "Pushing %d samples to 0x%x\n", this->watermark, this->dma_addr);
+    this->dma_req.init();
+    this->dma_req.set_addr(this->dma_addr);
+    this->dma_req.set_size(this->watermark * sizeof(uint32_t));
+    this->dma_req.set_is_write(true);
+    this->dma_req.set_data((uint8_t *)this->dma_buffer.data());
+    this->dma_pending = true;
+
+    vp::IoReqStatus status = this->dma_itf.req(&this->dma_req);
+    if (status == vp::IO_REQ_OK)
+    {
+        this->dma_pending = false;
+        this->status |= sensor_status_dma;
+    }
+    else if (status == vp::IO_REQ_INVALID)
     {
-        this->background_power.dynamic_power_start();
+        this->trace.force_warning("Invalid DMA push of %d samples to 0x%x\n", this->watermark, this->dma_addr);
+        this->dma_pending = false;
+        this->status |= sensor_status_overflow;
     }
+}
+
+void MySensor::dma_grant(vp::Block *__this, vp::IoReq *req)
+{
+}
+
+void MySensor::dma_resp(vp::Block *__this, vp::IoReq *req)
+{
+    MySensor *_this = (MySensor *)__this;
+    _this->dma_pending = false;
+    _this->status |= sensor_status_dma;
+    _this->update_irq();
+}
+
+// The sensor is off or in standby according to its supply, and otherwise in
+// the low or high rate mode according to its sampling period. Sampling only
+// runs while the supply is on.
+void MySensor::update_mode()
+{
+    bool sampling = (this->ctrl & sensor_ctrl_sampling) && this->supply == vp::PowerSupplyState::ON;
+    int mode;
+
+    if (this->supply == vp::PowerSupplyState::OFF)
+        mode = SENSOR_OFF;
+    else if (this->supply == vp::PowerSupplyState::ON_CLOCK_GATED)
+        mode = SENSOR_STANDBY;
+    else if (sampling && this->period < this->high_rate_period)
+        mode = SENSOR_HIGH_RATE;
     else
+        mode = SENSOR_LOW_RATE;
+
+    if (mode != this->mode)
     {
-        this->background_power.dynamic_power_stop();
+        this->trace.msg(vp::TraceLevel::DEBUG, "Switching to mode %s\n", sensor_mode_names[mode]);
+        if (this->mode != SENSOR_OFF)
+            this->mode_power[this->mode].dynamic_power_stop();
+        else
+            this->background_power.leakage_power_start();
+
+        if (mode != SENSOR_OFF)
+            this->mode_power[mode].dynamic_power_start();
+        else
+            this->background_power.leakage_power_stop();
+
+        this->mode = mode;
+        this->vcd_mode.set(mode);
+        if (this->mode_itf.is_bound())
+            this->mode_itf.sync(mode);
     }
+
+    if (sampling && !this->sample_event.is_enqueued())
+        this->sample_event.enqueue(this->period);
+    else if (!sampling && this->sample_event.is_enqueued())
+        this->sample_event.cancel();
+}
+
+void MySensor::handle_sample(vp::Block *__this, vp::ClockEvent *event)
+{
+    MySensor *_this = (MySensor *)__this;
+
+    _this->access_power.account_energy_quantum();
+    _this->activity.busy_cycles += _this->conversion_cycles;
+    if (_this->fifo.size() < _this->fifo_depth)
+        _this->fifo.push_back(_this->sample());
+    else
+        _this->status |= sensor_status_overflow;
+    _this->update_irq();
+
+    _this->sample_event.enqueue(_this->period);
+}
+
+void MySensor::start_conversion(vp::IoReq *req)
+{
+    int64_t cycles = this->woken_up ? this->wake_conversion_cycles : this->conversion_cycles;
+    if (this->mode == SENSOR_STANDBY)
+        cycles += this->standby_wake_cycles;
+    this->pending_req = req;
+    this->activity.busy_cycles += cycles;
+    this->event.enqueue(cycles);
+    this->woken_up = false;
+}
+
+void MySensor::handle_event(vp::Block *__this, vp::ClockEvent *event)
+{
+    MySensor *_this = (MySensor *)__this;
+    vp::IoReq *req = _this->pending_req;
+
+    // the sample is taken at the end of the conversion
+    *(uint32_t *)req->get_data() = _this->sample();
+    _this->vcd_value.set(*(uint32_t *)req->get_data());
+    _this->pending_req = NULL;
+    if (!_this->waiting_reqs.empty())
+    {
+        _this->start_conversion(_this->waiting_reqs.front());
+        _this->waiting_reqs.pop();
+    }
+    req->get_resp_port()->resp(req);
+}
+
+extern "C" Component *gv_new(ComponentConf &config)
+{
+    return new MySensor(config);
+}
+
+void MySensor::reset(bool active)
+{
+    if (!active && this->activity_itf.is_bound())
+        this->activity_itf.sync(&this->activity);
+    if (!active && this->mode_itf.is_bound())
+        this->mode_itf.sync(this->mode);
+}
+
+void MySensor::power_supply_set(vp::PowerSupplyState state)
+{
+    if (state == vp::PowerSupplyState::ON && this->supply == vp::PowerSupplyState::OFF)
+        this->woken_up = true;
+    this->supply = state;
+    this->update_mode();
 }
\ No newline at end of file
@@ -1,24 +1,81 @@
+import os
+import struct
+import zlib
 import gvsoc.systree as gsys
 
 
+def write_sensor_trace(path, samples):
+    # writes a trace file for GenericSensor from a list of (time in ps, value)
+    with open(path, "wb") as trace:
+        for time, value in sorted(samples):
+            trace.write(struct.pack("<qII", time, value, 0))
+
+
 class GenericSensor(gsys.Component):
-    def __init__(self, parent: gsys.Component, name: str):
+    def __init__(
+        self,
+        parent: gsys.Component,
+        name: str,
+        trace_file=None,
+        trace_mode="loop",
+        seed=None,
+        conversion_cycles=2000,
+        wake_conversion_cycles=20000,
+        fifo_depth=64,
+        high_rate_period=10000,
+        standby_wake_cycles=500,
+        off_access="error",
+        off_latency_cycles=100000,
+        mode_power=None
+    ):
         super().__init__(parent, name)
         self.add_sources(["my_sensor.cpp"])
 
+        if trace_mode not in ["loop", "hold"]:
+            raise ValueError(f"{name}: unknown trace mode {trace_mode}, expected loop or hold")
+        # without seed, each sensor gets its own one derived from its name
+        if seed is None:
+            seed = zlib.crc32(name.encode())
+        if off_access not in ["error", "latency"]:
+            raise ValueError(f"{name}: unknown off access policy {off_access}, expected error or latency")
+        # dynamic power of each mode in W, at 600 and 1200 mV
+        if mode_power is None:
+            mode_power = {
+                "standby": (0.00002, 0.00005),
+                "low_rate": (0.00020, 0.00050),
+                "high_rate": (0.00080, 0.00200),
+            }
+        self.mode_power = mode_power
+
         self.add_properties(
             {
-                "background_power": {
-                    "dynamic": {
-                        "type": "linear",
-                        "unit": "W",
-                        "values": {
-                            "25": {
-                                "600.0": {"any": 0.00020},
-                                "1200.0": {"any": 0.00050},
-                            }
-                        },
+                "data": {
+                    "trace": os.path.abspath(trace_file) if trace_file is not None else "",
+                    "mode": trace_mode,
+                    "seed": seed & 0x7fffffff,
+                },
+                # duration of a conversion in cycles of the sensor clock, the
+                # first one after a power-up takes wake_conversion_cycles
+                "conversion_cycles": conversion_cycles,
+                "wake_conversion_cycles": wake_conversion_cycles,
+                "fifo_depth": fifo_depth,
+                # the sensor is off or in standby following its supply, and
+                # otherwise in high_rate mode while it samples into its FIFO
+                # with a period below high_rate_period cycles
+                "modes": {
+                    "high_rate_period": high_rate_period,
+                    # accesses while off fail, or with "latency" are only
+                    # delayed by off/latency_cycles, the sensor staying off
+                    "off_access": off_access,
+                    "off": {"latency_cycles": off_latency_cycles},
+                    "standby": {
+                        "wake_cycles": standby_wake_cycles,
+                        "power": self.__mode_power(*mode_power["standby"]),
                     },
+                    "low_rate": {"power": self.__mode_power(*mode_power["low_rate"])},
+                    "high_rate": {"power": self.__mode_power(*mode_power["high_rate"])},
+                },
+                "background_power": {
                     "leakage": {
                         "type": "linear",
                         "unit": "W",
@@ -45,13 +102,48 @@ class GenericSensor(gsys.Component):
             }
         )
 
+    def nominal_mode_power(self):
+        # dynamic power in W at 1200 mV of each mode, indexed like the mode wire
+        return [0.0] + [self.mode_power[mode][1] for mode in ["standby", "low_rate", "high_rate"]]
+
+    def __mode_power(self, power_600, power_1200):
+        return {
+            "dynamic": {
+                "type": "linear",
+                "unit": "W",
+                "values": {
+                    "25": {
+                        "600.0": {"any": power_600},
+                        "1200.0": {"any": power_1200},
+                    }
+                },
+            }
+        }
+
     def gen_gtkw(self, tree, comp_traces):
         if tree.get_view() == "overview":
             tree.add_trace(self, self.name, vcd_signal="status[31:0]", tag="overview")
+            tree.add_trace(self, self.name + " mode", vcd_signal="mode[1:0]", tag="overview")
 
     def i_INPUT(self) -> gsys.SlaveItf:
         return gsys.SlaveItf(self, "input", signature="io")
 
+    def o_ACTIVITY(self, itf: gsys.SlaveItf):
+        # activity counters, sampled by the power manager
+        self.itf_bind("activity", itf, signature="wire<pm_activity *>")
+
+    def o_MODE(self, itf: gsys.SlaveItf):
+        # power mode, off, standby, low_rate or high_rate, for the power manager
+        self.itf_bind("mode", itf, signature="wire<int>")
+
+    def o_IRQ(self, itf: gsys.SlaveItf):
+        # watermark interrupt of the sample FIFO, or end of its push to memory
+        self.itf_bind("irq", itf, signature="wire<bool>")
+
+    def o_DMA(self, itf: gsys.SlaveItf):
+        # pushes the samples to memory at the watermark, see sensor_dma_addr
+        self.itf_bind("dma", itf, signature="io")
+
     def i_POWER_io(self) -> gsys.SlaveItf:
         return gsys.SlaveItf(self, "p_in", signature="io")
     
@@ -1,3 +1,4 @@
+import os
 from pulp.chips.pulp_open.pulp_open_board import Pulp_open_board
 from vp.clock_domain import Clock_domain
 import power_manager
@@ -11,11 +12,216 @@ import my_sensors
 
 GAPY_TARGET = True
 
+# internal power domains of pulp_open, each one made of the components at the
+# given paths from the chip
+PULP_OPEN_DOMAINS = {
+    "fc": [["soc", "fc"]],
+    "cluster": [["cluster"]],
+    "l2_priv0": [["soc", "l2_priv0"]],
+    "l2_priv1": [["soc", "l2_priv1"]],
+    "l2_shared_0": [["soc", "l2_shared_0"]],
+    "l2_shared_1": [["soc", "l2_shared_1"]],
+    "l2_shared_2": [["soc", "l2_shared_2"]],
+    "l2_shared_3": [["soc", "l2_shared_3"]],
+    "periph": [["soc", "udma"], ["soc", "fc_timer"], ["soc", "apb_soc_ctrl"]],
+}
+
+# event lines of the interrupt controller of the fabric controller raised by
+# the sensors, left free by pulp_open, as in examples/sensor_fifo.c
+SENSOR_FC_EVENTS = {"sensor1": 22, "sensor2": 23, "sensor3": 24}
+
+
+class PmPulpOpenBoard(Pulp_open_board):
+    """Pulp_open_board whose external AXI, which pulp_open always ends in the
+    AXI proxy of its chip, can instead end in a new output port axi_itf of the
+    board, so that it can be bound to a component of the system without going
+    through the launcher."""
+
+    def __init__(self, parent, name, parser, options, axi_itf=None, **kwargs):
+        super().__init__(parent, name, parser, options, **kwargs)
+        if axi_itf is not None:
+            self.__export_axi(axi_itf)
+
+    def __export_axi(self, itf_name):
+        # pulp_open has no option to leave its AXI proxy out, so its binding is
+        # replaced through the bind API, and a chip built differently is an error
+        # rather than a silently unrouted AXI
+        chip = self.components["chip"]
+        axi_proxy = chip.components.get("axi_proxy")
+        found = [
+            binding for binding in chip.bindings
+            if len(binding) >= 4 and binding[2] is axi_proxy and binding[3] == "input"
+        ]
+        if axi_proxy is None or len(found) != 1:
+            raise RuntimeError("pulp_open: couldn't find the binding of the external AXI to its AXI proxy")
+        master, master_itf = found[0][0], found[0][1]
+        chip.bindings.remove(found[0])
+        chip.bind(master, master_itf, chip, itf_name)
+        self.bind(chip, itf_name, self, itf_name)
+
+
+def export_power_inputs(host, path, prefix):
+    """Export the power supply and voltage inputs of the pulp_open component at
+    path (names from the chip down) as input ports of the board, named after
+    prefix, and return them as (power, voltage) interfaces of the board."""
+    parents = [host, host.components["chip"]]
+    for name in path[:-1]:
+        if name not in parents[-1].components:
+            raise RuntimeError(f"pulp_open has no component {'/'.join(path)}")
+        parents.append(parents[-1].components[name])
+    if path[-1] not in parents[-1].components:
+        raise RuntimeError(f"pulp_open has no component {'/'.join(path)}")
+    component = parents[-1].components[path[-1]]
+
+    exported = []
+    for itf in (component.i_POWER(), component.i_VOLTAGE()):
+        itf_name = f"{prefix}_{itf.itf_name}"
+        child, child_itf = component, itf.itf_name
+        for parent in reversed(parents):
+            parent.bind(parent, itf_name, child, child_itf)
+            child, child_itf = parent, itf_name
+        exported.append(gvsoc.systree.SlaveItf(host, itf_name, signature=itf.signature))
+    return exported
+
+
+def export_soc_clock(host, itf_name):
+    """Export the control of the SoC clock domain of pulp_open, which clocks
+    the fabric controller, as a new input port itf_name of the board, and
+    return it."""
+    chip = host.components["chip"]
+    if "soc_clock_domain" not in chip.components:
+        raise RuntimeError("pulp_open has no component soc_clock_domain")
+    chip.bind(chip, itf_name, chip.components["soc_clock_domain"], "clock_in")
+    host.bind(host, itf_name, chip, itf_name)
+    return gvsoc.systree.SlaveItf(host, itf_name, signature="clock_ctrl")
+
+
+def export_fc_busy(host, itf_name):
+    """Export the busy status of the fabric controller of pulp_open, which goes
+    down while the core waits for an interrupt, as a new output port itf_name of
+    the board."""
+    chip = host.components["chip"]
+    soc = chip.components["soc"]
+    soc.bind(soc.components["fc"], "busy", soc, itf_name)
+    chip.bind(soc, itf_name, chip, itf_name)
+    host.bind(chip, itf_name, host, itf_name)
+
+
+def export_fc_event(host, itf_name, line):
+    """Export the event line of the interrupt controller of the fabric controller
+    of pulp_open as a new input port itf_name of the board, and return it."""
+    chip = host.components["chip"]
+    soc = chip.components["soc"]
+    if "fc_itc" not in soc.components:
+        raise RuntimeError("pulp_open has no component soc/fc_itc")
+    soc.bind(soc, itf_name, soc.components["fc_itc"], f"in_event_{line}")
+    chip.bind(chip, itf_name, soc, itf_name)
+    host.bind(host, itf_name, chip, itf_name)
+    return gvsoc.systree.SlaveItf(host, itf_name, signature="wire<bool>")
+
+
+def export_soc_input(host, itf_name):
+    """Export the input of the SoC interconnect of pulp_open, through which the
+    cluster reaches the L2, as a new input port itf_name of the board, and
+    return it."""
+    chip = host.components["chip"]
+    soc = chip.components["soc"]
+    chip.bind(chip, itf_name, soc, "soc_input")
+    host.bind(host, itf_name, chip, itf_name)
+    return gvsoc.systree.SlaveItf(host, itf_name, signature="io")
+
+
 class PulpBoard(gvsoc.systree.Component):
     def __init__(self, parent, name, parser, options):
         super().__init__(parent, name, options=options)
-        
-        host= Pulp_open_board(self, "host", parser, options, use_ddr=False)
+
+        parser.add_argument(
+            "--pm-routing",
+            dest="pm_routing",
+            choices=["native", "launcher"],
+            default="native",
+            help="Route the PULP external AXI to the PowerManager inside the simulation (native) or through the launcher",
+        )
+        parser.add_argument(
+            "--pm-controller",
+            dest="pm_controller",
+            default=None,
+            help="Shared memory name of an external controller driving the PowerManager, e.g. /pm_controller",
+        )
+        parser.add_argument(
+            "--pm-telemetry",
+            dest="pm_telemetry",
+            default=None,
+            help="File where the PowerManager mirrors the state of its domains, read by pm_top",
+        )
+        parser.add_argument(
+            "--pm-wake-on-access",
+            dest="pm_wake_on_access",
+            default="",
+            help="Comma-separated sensors which the PowerManager powers up on their first access, e.g. sensor1,sensor2",
+        )
+        parser.add_argument(
+            "--pm-governor",
+            dest="pm_governor",
+            default="",
+            help="Comma-separated domains whose voltage is driven by the PowerManager DVFS governor, e.g. host",
+        )
+        parser.add_argument(
+            "--pm-governor-policy",
+            dest="pm_governor_policy",
+            choices=["ondemand", "conservative"],
+            default="conservative",
+            help="Policy of the DVFS governor",
+        )
+        parser.add_argument(
+            "--pm-power-cap",
+            dest="pm_power_cap",
+            type=float,
+            default=None,
+            help="Chip-level power budget in W enforced by the PowerManager",
+        )
+        parser.add_argument(
+            "--pm-domain-cap",
+            dest="pm_domain_cap",
+            action="append",
+            default=[],
+            help="Power budget of a domain in W enforced by the PowerManager, e.g. host=0.005, can be repeated",
+        )
+        parser.add_argument(
+            "--pm-rails",
+            dest="pm_rails",
+            default=None,
+            help="JSON file grouping the domains on shared regulators, e.g. pm_rails.json",
+        )
+        parser.add_argument(
+            "--pm-inrush",
+            dest="pm_inrush",
+            choices=["flag", "serialize"],
+            default="flag",
+            help="Report the power-ups exceeding the current limit of their rail, or delay them",
+        )
+        parser.add_argument(
+            "--pm-auto-cg",
+            dest="pm_auto_cg",
+            action="store_true",
+            help="Clock gate the host while its core waits for an interrupt, and switch it back on when it wakes up",
+        )
+        parser.add_argument(
+            "--pm-pulp-domains",
+            dest="pm_pulp_domains",
+            action="store_true",
+            help="Manage the FC, the cluster, the L2 banks and the peripherals of pulp_open as separate PowerManager domains",
+        )
+        [args, __] = parser.parse_known_args()
+        wake_on_access = [name for name in args.pm_wake_on_access.split(",") if name != ""]
+        governed = [name for name in args.pm_governor.split(",") if name != ""]
+
+        # the core accesses reach the interconnect directly in native routing,
+        # the launcher is then optional
+        host = PmPulpOpenBoard(
+            self, "host", parser, options, use_ddr=False,
+            axi_itf="pm_axi" if args.pm_routing == "native" else None,
+        )
         
         # # connect the power control
         # # instantiate power manager
@@ -25,6 +231,8 @@ class PulpBoard(gvsoc.systree.Component):
         axi_pm = interco.router_proxy.Router_proxy(self, 'axi_pm')
         
         self.bind(axi_pm, 'out', ico, 'input')
+        if args.pm_routing == "native":
+            self.bind(host, 'pm_axi', ico, 'input')
         
         sensor1 = my_sensors.GenericSensor(self, "sensor1")
         sensor2 = my_sensors.GenericSensor(self, "sensor2")
@@ -36,33 +244,63 @@ class PulpBoard(gvsoc.systree.Component):
         soc_clock.o_CLOCK(sensor2.i_CLOCK())
         soc_clock.o_CLOCK(sensor3.i_CLOCK())
         
-        ico.o_MAP(
-            sensor1.i_INPUT(),
-            "sensor1",
-            base=0x20000000,
-            size=0x00001000,
-            rm_base=True,
-            latency=100,
-        )
-        ico.o_MAP(
-            sensor2.i_INPUT(),
-            "sensor2",
-            base=0x20000100,
-            size=0x00001000,
-            rm_base=True,
-            latency=200,
+        # the sensors sit behind the interconnect, which is only powered while the
+        # host is, as are the internal domains of pulp_open, which are inside it
+        host_domains = list(PULP_OPEN_DOMAINS.keys()) if args.pm_pulp_domains else []
+        pm = power_manager.PowerManager(
+            self,
+            "pm",
+            component_list=[{"host": host_domains + [{"ico": ["sensor1", "sensor2", "sensor3"]}]}],
+            gen_dir=getattr(args, "work_dir", None),
+            release=os.environ.get("PM_RELEASE") == "1",
+            controller=args.pm_controller,
+            telemetry=args.pm_telemetry,
+            wake_on_access=wake_on_access,
+            governor=governed or None,
+            governor_policy=args.pm_governor_policy,
+            power_cap=args.pm_power_cap,
+            rails=args.pm_rails,
+            inrush_policy=args.pm_inrush,
+            auto_cg=["host"] if args.pm_auto_cg else None,
+            busy=["host"],
+            mode_power={sensor.name: sensor.nominal_mode_power() for sensor in (sensor1, sensor2, sensor3)},
+            nested=host_domains,
+            domain_caps={name: float(budget) for name, budget in (cap.split("=") for cap in args.pm_domain_cap)} or None,
         )
-        ico.o_MAP(
-            sensor3.i_INPUT(),
-            "sensor3",
-            base=0x20000200,
-            size=0x00001000,
-            rm_base=True,
-            latency=300,
-        )
-        pm = power_manager.PowerManager(self, "pm", component_list=["host", "sensor1", "sensor2", "sensor3"])
         soc_clock.o_CLOCK(pm.i_CLOCK())
 
+        # sensors with wake-on-access are reached through the power manager.
+        # Each sensor raises its own event line of the fabric controller, and
+        # pushes its samples to the L2 through the SoC interconnect.
+        sensor_maps = [
+            (sensor1, 0x20000000, 100, SENSOR_FC_EVENTS["sensor1"]),
+            (sensor2, 0x20000100, 200, SENSOR_FC_EVENTS["sensor2"]),
+            (sensor3, 0x20000200, 300, SENSOR_FC_EVENTS["sensor3"]),
+        ]
+        sensor_dma = export_soc_input(host, "sensor_dma")
+        for sensor, base, latency, fc_event in sensor_maps:
+            sensor.o_IRQ(export_fc_event(host, sensor.name + "_irq", fc_event))
+            sensor.o_DMA(sensor_dma)
+            target = sensor.i_INPUT()
+            if sensor.name in wake_on_access:
+                target = getattr(pm, "i_TAP_" + sensor.name)()
+                getattr(pm, "o_TAP_" + sensor.name)(sensor.i_INPUT())
+            ico.o_MAP(
+                target,
+                sensor.name,
+                base=base,
+                size=0x00001000,
+                rm_base=True,
+                latency=latency,
+            )
+        # the busy cycles of the host come from the busy status of the FC
+        export_fc_busy(host, "fc_busy")
+        self.bind(host, "fc_busy", pm, "busy_host")
+        # markers of the firmware are sent to the launcher through the AXI proxy,
+        # only when there is one to handle them
+        if args.pm_routing == "launcher":
+            self.bind(pm, 'marker', axi_pm, 'input')
+
         #connect power manager to pulp
         ico.o_MAP(
             pm.i_INPUT_STATE(),
@@ -104,8 +342,41 @@ class PulpBoard(gvsoc.systree.Component):
             size=0x00000100,
             rm_base=True
         )
+        ico.o_MAP(
+            pm.i_ACTIVITY(),
+            "pm_activity",
+            base=0x20009000,
+            size=0x00001000,
+            rm_base=True
+        )
+        # the governor sets the frequency of the FC along with its voltage
+        if "host" in governed:
+            pm.o_FREQUENCY_CTRL_host(export_soc_clock(host, "soc_clock_ctrl"))
         pm.o_POWER_CTRL_host(host.i_POWER())
         pm.o_VOLTAGE_CTRL_host(host.i_VOLTAGE())
+        for domain in host_domains:
+            for path in PULP_OPEN_DOMAINS[domain]:
+                power, voltage = export_power_inputs(host, path, domain + "_" + path[-1])
+                getattr(pm, "o_POWER_CTRL_" + domain)(power)
+                getattr(pm, "o_VOLTAGE_CTRL_" + domain)(voltage)
+        pm.o_POWER_CTRL_ico(ico.i_POWER())
+        pm.o_VOLTAGE_CTRL_ico(ico.i_VOLTAGE())
+
+        pm.o_POWER_CTRL_sensor1(sensor1.i_POWER())
+        pm.o_POWER_CTRL_sensor2(sensor2.i_POWER())
+        pm.o_POWER_CTRL_sensor3(sensor3.i_POWER())
+
+        pm.o_VOLTAGE_CTRL_sensor1(sensor1.i_VOLTAGE())
+        pm.o_VOLTAGE_CTRL_sensor2(sensor2.i_VOLTAGE())
+        pm.o_VOLTAGE_CTRL_sensor3(sensor3.i_VOLTAGE())
+
+        sensor1.o_ACTIVITY(pm.i_ACTIVITY_sensor1())
+        sensor2.o_ACTIVITY(pm.i_ACTIVITY_sensor2())
+        sensor3.o_ACTIVITY(pm.i_ACTIVITY_sensor3())
+
+        sensor1.o_MODE(pm.i_MODE_sensor1())
+        sensor2.o_MODE(pm.i_MODE_sensor2())
+        sensor3.o_MODE(pm.i_MODE_sensor3())
       
 # This is the top target that gapy will instantiate
 class Target(gvsoc.runner.Target):
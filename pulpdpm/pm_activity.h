@@ -0,0 +1,28 @@
+// Activity counters of a managed component. The component owns the counters
+// and hands their address to the PowerManager through its activity wire at
+// reset, the manager then samples them whenever a policy or the firmware
+// needs them, so counting costs the component a few increments.
+#pragma once
+
+#include <cstdint>
+
+// counters, in the order of the activity window of each domain
+#define PM_ACTIVITY_REQUESTS 0
+#define PM_ACTIVITY_BYTES 1
+#define PM_ACTIVITY_BUSY_CYCLES 2
+#define PM_ACTIVITY_IDLE_CYCLES 3
+#define PM_ACTIVITY_NB_COUNTERS 4
+
+typedef struct
+{
+	// IO requests accepted by the component and their size
+	uint64_t requests;
+	uint64_t bytes;
+	// cycles of the component clock spent on work
+	uint64_t busy_cycles;
+	// cycles of the component clock spent waiting while powered, for the
+	// components whose busy status is bound to the manager
+	uint64_t idle_cycles;
+} pm_activity;
+
+static_assert(sizeof(pm_activity) == PM_ACTIVITY_NB_COUNTERS * sizeof(uint64_t), "counters are read as an array");
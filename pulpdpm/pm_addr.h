@@ -1,24 +1,43 @@
-// defined states in power manager
-#define off 0x0
-#define on_clock_gated 0x1
-#define on 0x3
+// pm_states.h and pm_domains.h are generated in the build directory when the
+// system is prepared, it must be in the include path of the application
+#include "pm_states.h"
+
+// base addresses of the PowerManager windows, as mapped in my_system.py
+#define pm_state 0x20004000
+#define pm_voltage 0x20005000
+#define pm_report 0x20006000
+#define pm_config_delay_state 0x20007000
+#define pm_config_delay_voltage 0x20008000
+#define pm_activity 0x20009000
 
 // offset to control the power measurement
 #define start_capture 0x1
 #define stop_capture 0
+// word offset in the report window of the marker register
+#define marker_offset 2
+// marker sent by the workloads once their setup is done, the launcher applies
+// its overrides there with --override-marker=1
+#define marker_setup 1
+
+// word offset of each 64-bit counter in the activity window of a domain, the
+// low word must be read first
+#define activity_window_words 16
+#define activity_requests 0
+#define activity_bytes 2
+#define activity_busy_cycles 4
+#define activity_idle_cycles 6
+// The busy and idle cycles of the host are counted by the PowerManager from the
+// busy status of the FC, which goes down while it waits for an interrupt. The
+// requests and bytes of the ico are the accesses to its components with
+// wake-on-access, which go through the PowerManager, since the GVSoC router
+// counts none of the requests it routes. The sensors count their requests,
+// bytes and busy cycles.
 
 //offsets of the config registers
 #define on_off_offset 0
 #define off_on_offset 1
 #define on_cg_offset 2
 #define cg_on_offset 3
+#define latency_offset(from, to) (4 + (from) * nb_power_states + (to))
 
-//define pm addresses mapped to components
-#define host_offset 0
-#define host_config_offset 0
-#define sensor1_offset 1
-#define sensor1_config_offset 4
-#define sensor2_offset 2
-#define sensor2_config_offset 8
-#define sensor3_offset 3
-#define sensor3_config_offset 12
+#include "pm_domains.h"
@@ -0,0 +1,133 @@
+// Shared-memory channel between the PowerManager and an external policy
+// controller. At each decision epoch the PowerManager pushes one observation of
+// all its domains in the observation ring, then waits for the action of the
+// same epoch in the action ring. Each ring has a single producer and a single
+// consumer, so they only rely on the ordering of their head and tail indexes.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "pm_activity.h"
+
+#define PM_CHANNEL_MAGIC 0x504d4348
+#define PM_CHANNEL_MAX_DOMAINS 32
+#define PM_CHANNEL_SLOTS 64
+
+typedef struct
+{
+	int32_t state;
+	float voltage;
+	// fraction of the epoch spent in a state with the supply on
+	double on_fraction;
+	// energy accounted by the manager for the domain since the start, in J
+	double energy;
+	// counters of the component since the start, zero if it reports none
+	pm_activity counters;
+} pm_domain_observation;
+
+typedef struct
+{
+	uint64_t epoch;
+	int64_t time;
+	uint32_t nb_domains;
+	pm_domain_observation domains[PM_CHANNEL_MAX_DOMAINS];
+} pm_observation;
+
+typedef struct
+{
+	// state to request, -1 to keep the current one
+	int32_t state;
+	// voltage to apply, 0 or less to keep the current one
+	float voltage;
+} pm_domain_action;
+
+typedef struct
+{
+	uint64_t epoch;
+	pm_domain_action domains[PM_CHANNEL_MAX_DOMAINS];
+} pm_action;
+
+template <typename T>
+class PmRing
+{
+public:
+	bool push(const T &entry)
+	{
+		uint64_t tail = this->tail.load(std::memory_order_relaxed);
+		if (tail - this->head.load(std::memory_order_acquire) == PM_CHANNEL_SLOTS)
+			return false;
+		this->slots[tail % PM_CHANNEL_SLOTS] = entry;
+		this->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T &entry)
+	{
+		uint64_t head = this->head.load(std::memory_order_relaxed);
+		if (head == this->tail.load(std::memory_order_acquire))
+			return false;
+		entry = this->slots[head % PM_CHANNEL_SLOTS];
+		this->head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	// head is only written by the consumer and tail by the producer, they are
+	// kept on separate cache lines
+	alignas(64) std::atomic<uint64_t> head{0};
+	alignas(64) std::atomic<uint64_t> tail{0};
+	alignas(64) T slots[PM_CHANNEL_SLOTS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the channel needs lock-free 64 bits atomics");
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t nb_domains;
+	PmRing<pm_observation> observations;
+	PmRing<pm_action> actions;
+} pm_channel;
+
+// Maps the channel of the given POSIX shared memory name, creating and
+// clearing it if create is true. Returns NULL on failure.
+static inline pm_channel *pm_channel_open(std::string name, bool create)
+{
+	int fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+	if (fd < 0)
+		return NULL;
+
+	if (create && ftruncate(fd, sizeof(pm_channel)) < 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	void *addr = mmap(NULL, sizeof(pm_channel), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return NULL;
+
+	pm_channel *channel = (pm_channel *)addr;
+	if (create)
+	{
+		// the truncated memory is zero-filled, which is the empty state of the rings
+		channel->magic = PM_CHANNEL_MAGIC;
+	}
+	else if (channel->magic != PM_CHANNEL_MAGIC)
+	{
+		munmap(addr, sizeof(pm_channel));
+		return NULL;
+	}
+
+	return channel;
+}
+
+static inline void pm_channel_close(pm_channel *channel)
+{
+	munmap(channel, sizeof(pm_channel));
+}
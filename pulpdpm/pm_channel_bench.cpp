@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <sched.h>
+#include <unistd.h>
+#include "pm_channel.h"
+
+
+// Spins on a ring operation like the epoch barrier of the PowerManager, then
+// yields the core so that both sides progress on a loaded host
+template <typename F>
+static void wait_for(F done)
+{
+    for (unsigned int spin = 0; !done(); spin++)
+    {
+        if (spin >= 1000)
+        {
+            sched_yield();
+        }
+    }
+}
+
+
+// Measures the round-trip latency of the controller channel: the parent plays
+// the PowerManager, pushing observations and spinning on the actions like its
+// epoch barrier, and a forked child echoes each observation.
+int main(int argc, char *argv[])
+{
+    int nb_epochs = 100000;
+    unsigned int nb_domains = 5;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (strncmp(argv[i], "--epochs=", 9) == 0)
+        {
+            nb_epochs = atoi(&argv[i][9]);
+        }
+        else if (strncmp(argv[i], "--domains=", 10) == 0)
+        {
+            nb_domains = std::min(atoi(&argv[i][10]), PM_CHANNEL_MAX_DOMAINS);
+        }
+    }
+
+    std::string channel_name = "/pm_channel_bench_" + std::to_string(getpid());
+    pm_channel *channel = pm_channel_open(channel_name, true);
+    if (channel == NULL)
+    {
+        fprintf(stderr, "Couldn't create channel %s\n", channel_name.c_str());
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        pm_observation observation;
+        pm_action action;
+        for (int epoch = 0; epoch < nb_epochs; epoch++)
+        {
+            wait_for([&] { return channel->observations.pop(observation); });
+            action.epoch = observation.epoch;
+            for (unsigned int i = 0; i < observation.nb_domains; i++)
+            {
+                action.domains[i].state = observation.domains[i].state;
+                action.domains[i].voltage = observation.domains[i].voltage;
+            }
+            wait_for([&] { return channel->actions.push(action); });
+        }
+        return 0;
+    }
+
+    std::vector<double> latencies;
+    pm_observation observation = {};
+    pm_action action;
+    observation.nb_domains = nb_domains;
+    for (int epoch = 0; epoch < nb_epochs; epoch++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        observation.epoch = epoch;
+        wait_for([&] { return channel->observations.push(observation); });
+        wait_for([&] { return channel->actions.pop(action) && action.epoch == (uint64_t)epoch; });
+        std::chrono::duration<double, std::nano> latency = std::chrono::steady_clock::now() - start;
+        latencies.push_back(latency.count());
+    }
+
+    waitpid(pid, NULL, 0);
+    pm_channel_close(channel);
+    shm_unlink(channel_name.c_str());
+
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (double latency : latencies)
+    {
+        total += latency;
+    }
+    printf("%d epochs, %d domains: mean %.0f ns, p50 %.0f ns, p99 %.0f ns, max %.0f ns\n", nb_epochs, nb_domains,
+        total / nb_epochs, latencies[nb_epochs / 2], latencies[nb_epochs * 99 / 100], latencies.back());
+
+    return 0;
+}
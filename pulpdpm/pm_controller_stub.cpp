@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sched.h>
+#include <unistd.h>
+#include "pm_channel.h"
+
+
+// Minimal controller of the PowerManager. It answers each observation with
+// an action, so the simulation never waits more than the channel latency.
+// Domains whose on fraction over the epoch is below the threshold are sent to
+// the idle state, and woken up to the active state otherwise, if both are
+// given, otherwise the current states are kept.
+int main(int argc, char *argv[])
+{
+    std::string channel_name = "/pm_controller";
+    int idle_state = -1;
+    int active_state = -1;
+    double threshold = 0.1;
+    bool verbose = false;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (strncmp(argv[i], "--channel=", 10) == 0)
+        {
+            channel_name = &argv[i][10];
+        }
+        else if (strncmp(argv[i], "--idle-state=", 13) == 0)
+        {
+            idle_state = atoi(&argv[i][13]);
+        }
+        else if (strncmp(argv[i], "--active-state=", 15) == 0)
+        {
+            active_state = atoi(&argv[i][15]);
+        }
+        else if (strncmp(argv[i], "--threshold=", 12) == 0)
+        {
+            threshold = atof(&argv[i][12]);
+        }
+        else if (strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = true;
+        }
+    }
+
+    // The PowerManager creates the channel when the simulation starts
+    pm_channel *channel;
+    while ((channel = pm_channel_open(channel_name, false)) == NULL)
+    {
+        usleep(10000);
+    }
+
+    pm_observation observation;
+    pm_action action;
+    while (true)
+    {
+        if (!channel->observations.pop(observation))
+        {
+            sched_yield();
+            continue;
+        }
+
+        action.epoch = observation.epoch;
+        for (unsigned int i = 0; i < observation.nb_domains; i++)
+        {
+            pm_domain_observation &domain = observation.domains[i];
+            action.domains[i].state = -1;
+            action.domains[i].voltage = 0;
+            if (idle_state >= 0 && active_state >= 0)
+            {
+                action.domains[i].state = domain.on_fraction < threshold ? idle_state : active_state;
+            }
+
+            if (verbose)
+            {
+                printf("epoch %lu time %ld domain %d: state %d voltage %f on_fraction %f energy %e\n",
+                    observation.epoch, observation.time, i, domain.state, domain.voltage, domain.on_fraction, domain.energy);
+            }
+        }
+
+        while (!channel->actions.push(action))
+        {
+            sched_yield();
+        }
+    }
+
+    return 0;
+}
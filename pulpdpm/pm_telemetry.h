@@ -0,0 +1,85 @@
+// Memory-mapped telemetry of the PowerManager. The simulation is the only
+// writer and updates the file on each transition, readers such as pm_top map it
+// read-only and never block the writer: they retry their copy whenever the
+// sequence number was odd or changed while they were reading it.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define PM_TELEMETRY_MAGIC 0x504d544c
+#define PM_TELEMETRY_MAX_DOMAINS 32
+#define PM_TELEMETRY_MAX_STATES 16
+#define PM_TELEMETRY_NAME_SIZE 32
+
+typedef struct
+{
+	char name[PM_TELEMETRY_NAME_SIZE];
+	int32_t state;
+	float voltage;
+	// energy of the domain since the start, in J, its estimated power and the
+	// energy of its transitions
+	double energy;
+	int64_t last_change;
+} pm_telemetry_domain;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t nb_domains;
+	uint32_t nb_states;
+	char states[PM_TELEMETRY_MAX_STATES][PM_TELEMETRY_NAME_SIZE];
+	// odd while the writer updates the content below
+	std::atomic<uint64_t> seq;
+	int64_t time;
+	pm_telemetry_domain domains[PM_TELEMETRY_MAX_DOMAINS];
+} pm_telemetry;
+
+// Maps the telemetry file, creating it for the writer. Returns NULL on failure.
+static inline pm_telemetry *pm_telemetry_open(std::string path, bool writer)
+{
+	int fd = open(path.c_str(), writer ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	if (fd < 0)
+		return NULL;
+
+	if (writer && ftruncate(fd, sizeof(pm_telemetry)) < 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	void *addr = mmap(NULL, sizeof(pm_telemetry), writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return NULL;
+
+	return (pm_telemetry *)addr;
+}
+
+static inline void pm_telemetry_write_begin(pm_telemetry *telemetry)
+{
+	telemetry->seq.store(telemetry->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+static inline void pm_telemetry_write_end(pm_telemetry *telemetry)
+{
+	telemetry->seq.store(telemetry->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Copies a consistent snapshot of the telemetry, returns false if the writer
+// was updating it
+static inline bool pm_telemetry_read(const pm_telemetry *telemetry, pm_telemetry *snapshot)
+{
+	uint64_t seq = telemetry->seq.load(std::memory_order_acquire);
+	if (seq & 1)
+		return false;
+	memcpy((void *)snapshot, (const void *)telemetry, sizeof(pm_telemetry));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return telemetry->seq.load(std::memory_order_relaxed) == seq;
+}
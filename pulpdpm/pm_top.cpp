@@ -0,0 +1,70 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "pm_telemetry.h"
+
+
+// Live view of the PowerManager telemetry, refreshed every interval ms until
+// the simulation is over or the user stops it
+int main(int argc, char *argv[])
+{
+    std::string path = "build/pm_telemetry";
+    int interval = 200;
+    bool once = false;
+
+    for (int i=1; i<argc; i++)
+    {
+        if (strncmp(argv[i], "--file=", 7) == 0)
+        {
+            path = &argv[i][7];
+        }
+        else if (strncmp(argv[i], "--interval=", 11) == 0)
+        {
+            interval = atoi(&argv[i][11]);
+        }
+        else if (strcmp(argv[i], "--once") == 0)
+        {
+            once = true;
+        }
+    }
+
+    pm_telemetry *telemetry = pm_telemetry_open(path, false);
+    if (telemetry == NULL || telemetry->magic != PM_TELEMETRY_MAGIC)
+    {
+        fprintf(stderr, "Couldn't open telemetry file %s, is the simulation configured with --pm-telemetry?\n", path.c_str());
+        return -1;
+    }
+
+    pm_telemetry snapshot;
+    while (true)
+    {
+        while (!pm_telemetry_read(telemetry, &snapshot))
+        {
+            usleep(10);
+        }
+
+        if (!once)
+        {
+            // clear the terminal
+            printf("\033[H\033[2J");
+        }
+        printf("time %.3f us\n\n", snapshot.time / 1e6);
+        printf("%-16s %-16s %8s %14s %16s\n", "domain", "state", "voltage", "energy (J)", "last change (us)");
+        for (unsigned int i = 0; i < snapshot.nb_domains && i < PM_TELEMETRY_MAX_DOMAINS; i++)
+        {
+            pm_telemetry_domain &domain = snapshot.domains[i];
+            const char *state = domain.state >= 0 && (uint32_t)domain.state < snapshot.nb_states ? snapshot.states[domain.state] : "?";
+            printf("%-16s %-16s %8.3f %14.6e %16.3f\n", domain.name, state, domain.voltage, domain.energy, domain.last_change / 1e6);
+        }
+        fflush(stdout);
+
+        if (once)
+        {
+            break;
+        }
+        usleep(interval * 1000);
+    }
+
+    return 0;
+}
@@ -1,102 +1,356 @@
 #include <vp/vp.hpp>
 #include <vp/signal.hpp>
 #include <vp/itf/io.hpp>
+#include <vp/itf/wire.hpp>
+#include <vp/itf/clock.hpp>
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include <queue>
 #include <utility>
+#include <vector>
+#include <chrono>
+#include <sched.h>
+#include "pm_activity.h"
+#include "pm_channel.h"
+#include "pm_telemetry.h"
 
 using namespace vp;
 
+// Debug traces of the manager. They compile out entirely when PM_NO_TRACE is
+// defined (release build of the module), and otherwise only evaluate and format
+// their arguments when the trace is active.
+#ifdef PM_NO_TRACE
+#define PM_TRACE(trace, ...) \
+	do                       \
+	{                        \
+	} while (0)
+#else
+#define PM_TRACE(trace, ...)                                 \
+	do                                                       \
+	{                                                        \
+		if ((trace).get_active())                            \
+			(trace).msg(vp::TraceLevel::DEBUG, __VA_ARGS__); \
+	} while (0)
+#endif
+
+// size in bytes of the delay configuration window of each domain
+#define CONFIG_WINDOW_SIZE 256
+
+// offset in the report window of the marker register
+#define REPORT_MARKER 8
+
+// size in bytes of the activity counters window of each domain
+#define ACTIVITY_WINDOW_SIZE 64
+
 typedef struct comp_to_change
 {
 	float voltage;
 	int address;
 } comp_to_change;
 
-static char statename[3][15] = {"OFF", "ON", "ON CLOCK GATED"};
+// One entry of the state table, shared by all the domains
+typedef struct power_state
+{
+	std::string name;
+	// supply state applied to the component, encodes both power and clocking
+	int supply;
+	// fraction of the domain leakage still consumed while the supply is off
+	double leakage;
+	// true if the context of the component is kept in this state
+	bool retention;
+} power_state;
+
+// Operating point of a domain under the governor
+typedef struct opp
+{
+	float voltage;
+	// frequency in Hz of the domain clock at this voltage
+	int64_t frequency;
+} opp;
+
+class PowerManager;
+
+// Regulator shared by a group of domains. Its output follows the highest
+// voltage requested by its domains, and its conversion losses come from the
+// load current: an LDO draws its load current from its input, a buck converter
+// follows an efficiency curve. Both also draw a quiescent current.
+class PowerRail
+{
+public:
+	PowerRail(PowerManager *top, std::string name);
+
+	std::string name;
+	std::vector<int> domains;
+	bool ldo;
+	double input_voltage;
+	double quiescent_current;
+	// (load current in A, efficiency) points, by increasing current
+	std::vector<std::pair<double, double>> efficiency;
+	double loss_energy = 0.0;
+	int64_t since = 0;
+	vp::Signal<float> voltage;
+	// current limit in A including in-rush, 0 for none
+	double max_current;
+	double peak_current = 0.0;
+	double peak_power = 0.0;
+	uint64_t inrush_violations = 0;
+};
+
+// State of one power domain. Domains form a tree: a domain can only be powered
+// while its parent is powered, children are switched off before their parent and
+// powered up after it, each one edge_delay ps after the parent reached ON.
+// Transitions between states of the table cost latency[from][to] ps and
+// energy[from][to] pJ.
+class PowerDomain
+{
+public:
+	PowerDomain(PowerManager *top, std::string name, TimeEventMeth *delay_handler);
+
+	std::string name;
+	int parent = -1;
+	std::vector<int> children;
+	// true if the component is inside the component of its parent domain, which
+	// propagates its own supply to it. Such a domain follows the state of its
+	// parent until the manager applies a state of its own to it.
+	bool nested = false;
+	bool pm_set = false;
+	unsigned int edge_delay = 0;
+	std::vector<std::vector<unsigned int>> latency;
+	std::vector<std::vector<double>> energy;
+	// nominal leakage in W, scaled by the state leakage while the supply is off
+	double leakage = 0.0;
+	int64_t state_since = 0;
+	// energy accounted by the manager for this domain, in J
+	double pm_energy = 0.0;
+	// time spent in a state with the supply on, in ps
+	int64_t active_time = 0;
+	int64_t epoch_active_time = 0;
+	int next_state;
+	// state waiting for the parent or the children before being applied, -1 if none
+	int pending_state = -1;
+	TimeEvent event;
+	vp::Signal<int> state;
+	vp::Signal<float> voltage;
+	WireMaster<int> power_ctrl_itf;
+	WireMaster<double> voltage_ctrl_itf;
+	// with wake-on-access, the accesses to the component go through the manager,
+	// which holds them while the domain is not on and powers it up
+	bool wake_on_access = false;
+	IoSlave tap_in_itf;
+	IoMaster tap_out_itf;
+	std::queue<vp::IoReq *> stalled_reqs;
+	// counters owned by the component, NULL if it reports no activity
+	WireSlave<pm_activity *> activity_itf;
+	pm_activity *activity = NULL;
+	// requests and bytes to the children with wake-on-access of the domain, which
+	// go through the manager, reported for a domain without counters
+	uint64_t tap_requests = 0;
+	uint64_t tap_bytes = 0;
+	// busy status of the core of the component, which goes down while the core
+	// waits for an interrupt. The manager counts from it the busy and idle
+	// cycles of the domain while its supply is not off.
+	bool has_busy = false;
+	bool busy = true;
+	WireSlave<bool> busy_itf;
+	double busy_cycles = 0.0;
+	double idle_cycles = 0.0;
+	// time in ps the core was busy with the domain on
+	int64_t busy_time = 0;
+	// power in W at the nominal voltage of each mode reported by the component
+	// on its mode wire, which replaces the dynamic power in the estimate, empty
+	// if the component reports no mode
+	std::vector<double> mode_power;
+	int mode = 0;
+	WireSlave<int> mode_itf;
+	// with automatic clock gating, the domain follows the busy status of its core:
+	// clock gated when the core waits for an interrupt, on when it wakes up
+	bool auto_cg = false;
+	bool auto_gated = false;
+	// shared regulator of the domain, -1 if it has its own ideal one
+	int rail = -1;
+	// in-rush current drawn when the supply is switched on, decaying linearly
+	// from inrush_current A to 0 in inrush_duration ps
+	double inrush_current = 0.0;
+	int64_t inrush_duration = 0;
+	int64_t inrush_start = -1;
+	float requested_voltage = 0.0;
+	// copy read over MMIO, so that the two words of a counter are consistent
+	pm_activity activity_sample = {};
+	// DVFS governor, which moves the domain between the operating points
+	bool governed = false;
+	int opp = 0;
+	int low_samples = 0;
+	int64_t gov_active_time = 0;
+	uint64_t gov_busy_cycles = 0;
+	int64_t gov_busy_time = 0;
+	vp::Signal<int64_t> frequency;
+	// control of the clock domain of the component, which then runs at the
+	// frequency of the operating point
+	vp::ClockMaster frequency_ctrl_itf;
+	// power capping: dynamic power in W while on at the nominal voltage, power
+	// budget in W (0 for none), and highest operating point allowed by the cap
+	double dynamic = 0.0;
+	double budget = 0.0;
+	int opp_cap = 0;
+	// true while the cap keeps the domain clock gated
+	bool cap_gated = false;
+	// energy estimated from the state and voltage of the domain, in J
+	double est_energy = 0.0;
+	// energy of the state transitions, which the estimate leaves out
+	double transition_energy = 0.0;
+	double window_energy = 0.0;
+	double peak_power = 0.0;
+	uint64_t violations = 0;
+	int64_t throttled_time = 0;
+};
+
 class PowerManager : public Component
 {
 
 public:
 	PowerManager(ComponentConf &config);
+	void reset(bool active) override;
 
 private:
 	static void voltage_delay_handler(vp::Block *__this, vp::TimeEvent *event);
+	static void domain_delay_handler(vp::Block *__this, vp::TimeEvent *event);
 	static vp::IoReqStatus handle_state(vp::Block *__this, vp::IoReq *req);
 	static vp::IoReqStatus handle_voltage(vp::Block *__this, vp::IoReq *req);
 	static vp::IoReqStatus handle_power_report(vp::Block *__this, vp::IoReq *req);
 	static vp::IoReqStatus handle_state_delay_config(vp::Block *__this, vp::IoReq *req);
 	static vp::IoReqStatus handle_voltage_delay_config(vp::Block *__this, vp::IoReq *req);
+	static vp::IoReqStatus handle_activity(vp::Block *__this, vp::IoReq *req);
+	static void activity_sync(vp::Block *__this, pm_activity *activity, int domain);
+	static void busy_sync(vp::Block *__this, bool busy, int domain);
+	static void mode_sync(vp::Block *__this, int mode, int domain);
+	pm_activity sample_activity(int domain);
+	int64_t domain_frequency(PowerDomain *d);
+	static void marker_grant(vp::Block *__this, vp::IoReq *req);
+	static void marker_resp(vp::Block *__this, vp::IoReq *req);
+	static vp::IoReqStatus handle_tap(vp::Block *__this, vp::IoReq *req, int domain);
+	static void tap_resp(vp::Block *__this, vp::IoReq *req);
+	static void tap_grant(vp::Block *__this, vp::IoReq *req);
+	vp::IoReqStatus forward_tap(int domain, vp::IoReq *req);
+	void release_stalled(int domain);
+	static void epoch_handler(vp::Block *__this, vp::TimeEvent *event);
+	static void governor_handler(vp::Block *__this, vp::TimeEvent *event);
+	double domain_load(int domain);
+	void set_opp(int domain, int opp);
+	static void cap_handler(vp::Block *__this, vp::TimeEvent *event);
+	bool throttle_chip();
+	bool release_chip();
+	void set_opp_cap(int domain, int opp_cap);
+	void stop() override;
+	bool wait_action(pm_action &action);
+	void set_voltage(int domain, float voltage);
+	void apply_voltage(int domain, float voltage);
+	double estimated_power(PowerDomain *d);
+	double rail_loss(PowerRail *rail, double load);
+	double inrush_current(PowerDomain *d, int64_t time);
+	double rail_current(PowerRail *rail, int64_t time);
+	int64_t inrush_delay(int domain);
+	void track_peaks();
+	void update_telemetry(int domain);
+	void signal_marker(uint32_t id);
+	void set_target_state(int domain, int state);
+	void start_transition(int domain, int state, unsigned int extra_delay);
+	bool children_off(int domain);
+	void resync_nested(int domain, int state);
+	bool follows_parent(PowerDomain *d) { return d->nested && !d->pm_set; }
+	bool is_powered(int state) { return this->states[state].supply != OFF; }
+	int find_state(std::string name);
+	void account_leakage();
+	void set_legacy_delay(PowerDomain *d, int reg, unsigned int value);
 	IoSlave input_state_itf;
 	IoSlave input_voltage_itf;
 	IoSlave power_report_itf;
 	IoSlave state_delay_config_itf;
 	IoSlave voltage_delay_config_itf;
+	IoSlave activity_itf;
+	// notifies the launcher that the firmware reached a marker, only bound when
+	// the system is routed through the launcher
+	IoMaster marker_itf;
+	IoReq marker_req;
+	uint32_t marker_id;
+	// true until the launcher replied to the last marker
+	bool marker_pending = false;
 	Trace trace;
 	double last_power_measure;
 	uint64_t delay_voltage_value = 1;
 	comp_to_change to_change;
+	std::vector<PowerDomain *> domains;
+	std::vector<PowerRail *> rails;
+	// power-ups which would exceed the current limit of their rail are delayed
+	// if true, and only reported otherwise
+	bool serialize_inrush = false;
+	double chip_peak_inst_power = 0.0;
+	std::vector<power_state> states;
+	// states addressed by the legacy delay registers and by the automatic power-up
+	int state_off;
+	int state_cg;
+	int state_on;
+	// energy accounted by the manager itself (transitions and retention leakage), in J
+	double pm_energy = 0.0;
+	double capture_pm_energy = 0.0;
+	int64_t capture_start_time = 0;
 
 	TimeEvent delay_voltage;
-	// GENERATED EVENTS
-	TimeEvent delay_host;
-	TimeEvent delay_sensor1;
-	TimeEvent delay_sensor2;
-	TimeEvent delay_sensor3;
-
-	// END GENERATED EVENTS
-
-	// GENERATED EVENT HANDLER DEFINITIONS
-	static void host_delay_handler(vp::Block *__this, vp::TimeEvent *event);
-	static void sensor1_delay_handler(vp::Block *__this, vp::TimeEvent *event);
-	static void sensor2_delay_handler(vp::Block *__this, vp::TimeEvent *event);
-	static void sensor3_delay_handler(vp::Block *__this, vp::TimeEvent *event);
-
-	// END EVENT HANDLER DEFNITIONS
-
-	// GENERATED INTERFACES
-	WireMaster<int> power_ctrl_itf_host;
-	WireMaster<double> voltage_ctrl_itf_host;
-	WireMaster<int> power_ctrl_itf_sensor1;
-	WireMaster<double> voltage_ctrl_itf_sensor1;
-	WireMaster<int> power_ctrl_itf_sensor2;
-	WireMaster<double> voltage_ctrl_itf_sensor2;
-	WireMaster<int> power_ctrl_itf_sensor3;
-	WireMaster<double> voltage_ctrl_itf_sensor3;
-
-	// END INTERFACES
-
-	// GENERATED DELAY REGISTERS
-	unsigned int host_delays[4] = {1,1,1,1};
-	int host_next_state;
-	unsigned int sensor1_delays[4] = {1,1,1,1};
-	int sensor1_next_state;
-	unsigned int sensor2_delays[4] = {1,1,1,1};
-	int sensor2_next_state;
-	unsigned int sensor3_delays[4] = {1,1,1,1};
-	int sensor3_next_state;
-
-	// END DELAY REGISTERS
-
-	// GENERATED VCD PS SIGNAL
-	vp::Signal<int> host_state;
-	vp::Signal<float> host_voltage;
-	vp::Signal<int> sensor1_state;
-	vp::Signal<float> sensor1_voltage;
-	vp::Signal<int> sensor2_state;
-	vp::Signal<float> sensor2_voltage;
-	vp::Signal<int> sensor3_state;
-	vp::Signal<float> sensor3_voltage;
-
-	// END GENERATED VCD PS SIGNAL
+
+	// external policy controller, NULL if decisions only come from the firmware
+	pm_channel *channel = NULL;
+	int64_t epoch_period;
+	// wall-clock time in ms after which the controller is considered gone
+	int64_t controller_timeout;
+	// set when the controller missed an epoch, no observation is sent anymore
+	bool controller_detached = false;
+	uint64_t epoch = 0;
+	TimeEvent epoch_event;
+
+	// live view of the domains for external readers, NULL if disabled
+	pm_telemetry *telemetry = NULL;
+
+	// operating points of the governed and capped domains, sorted by increasing voltage
+	std::vector<opp> opps;
+	bool governor = false;
+	int64_t governor_period;
+	bool governor_ondemand;
+	double up_threshold;
+	double down_threshold;
+	// low load samples needed before stepping down
+	int down_samples;
+	TimeEvent governor_event;
+
+	// power capping, the budgets are compared to the power estimated over each window
+	bool capping = false;
+	// chip-level budget in W, 0 for none
+	double chip_budget;
+	int64_t cap_period;
+	// throttling is released once the power is below this fraction of the budgets
+	double cap_release;
+	double nominal_voltage = 1.2;
+	// domains by increasing priority, throttled first for the chip budget
+	std::vector<int> throttle_order;
+	double chip_peak_power = 0.0;
+	uint64_t chip_violations = 0;
+	vp::Signal<double> chip_power;
+	TimeEvent cap_event;
 };
 
+PowerDomain::PowerDomain(PowerManager *top, std::string name, TimeEventMeth *delay_handler)
+	: name(name), event(top, delay_handler), state(*top, name + "_state", 3), voltage(*top, name + "_voltage", 32),
+	  frequency(*top, name + "_frequency", 64)
+{
+}
+
+PowerRail::PowerRail(PowerManager *top, std::string name)
+	: name(name), voltage(*top, name + "_rail_voltage", 32)
+{
+}
+
 PowerManager::PowerManager(ComponentConf &config)
-	: Component(config), delay_voltage(this, voltage_delay_handler)
-	  // GENERATED EVENT CONSTRUCTORS
-	, delay_host(this, host_delay_handler), host_state(*this, "host_state", 3), host_voltage(*this, "host_voltage", 32) 	, delay_sensor1(this, sensor1_delay_handler), sensor1_state(*this, "sensor1_state", 3), sensor1_voltage(*this, "sensor1_voltage", 32) 	, delay_sensor2(this, sensor2_delay_handler), sensor2_state(*this, "sensor2_state", 3), sensor2_voltage(*this, "sensor2_voltage", 32) 	, delay_sensor3(this, sensor3_delay_handler), sensor3_state(*this, "sensor3_state", 3), sensor3_voltage(*this, "sensor3_voltage", 32) 
-// END EVENT CONSTRUCTORS
+	: Component(config), delay_voltage(this, voltage_delay_handler), epoch_event(this, epoch_handler),
+	  governor_event(this, governor_handler), chip_power(*this, "chip_power", 64), cap_event(this, cap_handler)
 {
 	this->traces.new_trace("trace", &this->trace, vp::DEBUG);
 	this->new_slave_port("state_ctrl", &this->input_state_itf);
@@ -109,207 +363,687 @@ PowerManager::PowerManager(ComponentConf &config)
 	this->power_report_itf.set_req_meth(handle_power_report);
 	this->state_delay_config_itf.set_req_meth(handle_state_delay_config);
 	this->voltage_delay_config_itf.set_req_meth(handle_voltage_delay_config);
+	this->new_slave_port("activity", &this->activity_itf);
+	this->activity_itf.set_req_meth(handle_activity);
+	this->new_master_port("marker", &this->marker_itf);
+	this->marker_itf.set_resp_meth(marker_resp);
+	this->marker_itf.set_grant_meth(marker_grant);
+
+	for (js::Config *state_config : this->get_js_config()->get("states")->get_elems())
+	{
+		std::string supply = state_config->get_child_str("supply");
+		power_state state;
+		state.name = state_config->get_child_str("name");
+		state.supply = supply == "on" ? ON : supply == "cg" ? ON_CLOCK_GATED : OFF;
+		state.leakage = state_config->get("leakage")->get_double();
+		state.retention = state_config->get_child_bool("retention");
+		this->states.push_back(state);
+	}
+	this->state_off = this->find_state("off");
+	this->state_cg = this->find_state("on_clock_gated");
+	this->state_on = this->find_state("on");
+
+	// one domain per managed component, parents are listed before their children
+	js::Config *domains_config = this->get_js_config()->get("domains");
+	if (domains_config != NULL)
+	{
+		std::vector<js::Config *> elems = domains_config->get_elems();
+		for (unsigned int i = 0; i < elems.size(); i++)
+		{
+			std::string name = elems[i]->get_child_str("name");
+			PowerDomain *domain = new PowerDomain(this, name, domain_delay_handler);
+			this->new_master_port("power_ctrl_" + name, &domain->power_ctrl_itf);
+			this->new_master_port("voltage_ctrl_" + name, &domain->voltage_ctrl_itf);
+			domain->activity_itf.set_sync_meth_muxed(activity_sync, i);
+			this->new_slave_port("activity_" + name, &domain->activity_itf);
+			this->domains.push_back(domain);
+
+			domain->parent = elems[i]->get_child_int("parent");
+			domain->nested = elems[i]->get_child_bool("nested");
+			domain->edge_delay = elems[i]->get_child_int("edge_delay");
+			domain->leakage = elems[i]->get("leakage")->get_double();
+			domain->wake_on_access = elems[i]->get_child_bool("wake_on_access");
+			domain->dynamic = elems[i]->get("dynamic")->get_double();
+			domain->auto_cg = elems[i]->get_child_bool("auto_cg");
+			if (domain->auto_cg && (this->state_cg < 0 || this->state_on < 0))
+				this->trace.fatal("Automatic clock gating needs the on and on_clock_gated states\n");
+			for (js::Config *mode_config : elems[i]->get("modes")->get_elems())
+				domain->mode_power.push_back(mode_config->get_double());
+			if (domain->mode_power.size() > 0)
+			{
+				domain->mode_itf.set_sync_meth_muxed(mode_sync, i);
+				this->new_slave_port("mode_" + name, &domain->mode_itf);
+			}
+			domain->has_busy = elems[i]->get_child_bool("busy");
+			if (domain->has_busy)
+			{
+				domain->busy_itf.set_sync_meth_muxed(busy_sync, i);
+				this->new_slave_port("busy_" + name, &domain->busy_itf);
+			}
+			domain->inrush_current = elems[i]->get("inrush")->get("current")->get_double();
+			domain->inrush_duration = elems[i]->get("inrush")->get_child_int("duration");
+			if (domain->wake_on_access)
+			{
+				domain->tap_in_itf.set_req_meth_muxed(handle_tap, i);
+				this->new_slave_port("tap_in_" + name, &domain->tap_in_itf);
+				domain->tap_out_itf.set_resp_meth(tap_resp);
+				domain->tap_out_itf.set_grant_meth(tap_grant);
+				this->new_master_port("tap_out_" + name, &domain->tap_out_itf);
+			}
+			for (js::Config *row : elems[i]->get("latency")->get_elems())
+			{
+				std::vector<unsigned int> latency;
+				for (js::Config *value : row->get_elems())
+					latency.push_back(value->get_int());
+				domain->latency.push_back(latency);
+			}
+			for (js::Config *row : elems[i]->get("energy")->get_elems())
+			{
+				std::vector<double> energy;
+				for (js::Config *value : row->get_elems())
+					energy.push_back(value->get_double());
+				domain->energy.push_back(energy);
+			}
+			if (domain->parent >= 0)
+			{
+				this->domains[domain->parent]->children.push_back(i);
+			}
+		}
+	}
+
+	js::Config *controller_config = this->get_js_config()->get("controller");
+	if (controller_config != NULL && controller_config->get_child_str("channel") != "")
+	{
+		std::string channel_name = controller_config->get_child_str("channel");
+		if (this->domains.size() > PM_CHANNEL_MAX_DOMAINS)
+			this->trace.fatal("The controller channel supports at most %d domains\n", PM_CHANNEL_MAX_DOMAINS);
+		this->channel = pm_channel_open(channel_name, true);
+		if (this->channel == NULL)
+			this->trace.fatal("Couldn't create controller channel %s\n", channel_name.c_str());
+		this->channel->nb_domains = this->domains.size();
+		this->epoch_period = controller_config->get_child_int("epoch");
+		this->controller_timeout = controller_config->get_child_int("timeout");
+		if (this->controller_timeout <= 0)
+			this->trace.fatal("The controller timeout must be positive, got %ld ms\n", this->controller_timeout);
+	}
+
+	js::Config *rails_config = this->get_js_config()->get("rails");
+	if (rails_config != NULL)
+	{
+		for (js::Config *rail_config : rails_config->get_elems())
+		{
+			PowerRail *rail = new PowerRail(this, rail_config->get_child_str("name"));
+			rail->ldo = rail_config->get_child_str("type") == "ldo";
+			rail->input_voltage = rail_config->get("input_voltage")->get_double();
+			rail->quiescent_current = rail_config->get("quiescent_current")->get_double();
+			rail->max_current = rail_config->get("max_current")->get_double();
+			for (js::Config *point : rail_config->get("efficiency")->get_elems())
+			{
+				std::vector<js::Config *> values = point->get_elems();
+				rail->efficiency.push_back({values[0]->get_double(), values[1]->get_double()});
+			}
+			for (js::Config *domain_config : rail_config->get("domains")->get_elems())
+			{
+				for (unsigned int i = 0; i < this->domains.size(); i++)
+				{
+					if (this->domains[i]->name == domain_config->get_str())
+					{
+						this->domains[i]->rail = this->rails.size();
+						rail->domains.push_back(i);
+					}
+				}
+			}
+			this->rails.push_back(rail);
+		}
+	}
+
+	js::Config *inrush_config = this->get_js_config()->get("inrush_policy");
+	this->serialize_inrush = inrush_config != NULL && inrush_config->get_str() == "serialize";
 
-	// GENERATED POWER AND VOLTAGE PORTS
-	this->new_master_port("power_ctrl_host", &this->power_ctrl_itf_host);
-	this->new_master_port("voltage_ctrl_host", &this->voltage_ctrl_itf_host);
-	this->new_master_port("power_ctrl_sensor1", &this->power_ctrl_itf_sensor1);
-	this->new_master_port("voltage_ctrl_sensor1", &this->voltage_ctrl_itf_sensor1);
-	this->new_master_port("power_ctrl_sensor2", &this->power_ctrl_itf_sensor2);
-	this->new_master_port("voltage_ctrl_sensor2", &this->voltage_ctrl_itf_sensor2);
-	this->new_master_port("power_ctrl_sensor3", &this->power_ctrl_itf_sensor3);
-	this->new_master_port("voltage_ctrl_sensor3", &this->voltage_ctrl_itf_sensor3);
+	js::Config *opps_config = this->get_js_config()->get("opps");
+	if (opps_config != NULL)
+	{
+		for (js::Config *opp_config : opps_config->get_elems())
+			this->opps.push_back({(float)opp_config->get("voltage")->get_double(), opp_config->get_child_int("frequency")});
+	}
+
+	js::Config *governor_config = this->get_js_config()->get("governor");
+	if (governor_config != NULL && this->opps.size() > 0)
+	{
+		this->governor = true;
+		this->governor_period = governor_config->get_child_int("period");
+		this->governor_ondemand = governor_config->get_child_str("policy") == "ondemand";
+		this->up_threshold = governor_config->get("up_threshold")->get_double();
+		this->down_threshold = governor_config->get("down_threshold")->get_double();
+		this->down_samples = governor_config->get_child_int("down_samples");
+		for (js::Config *domain_config : governor_config->get("domains")->get_elems())
+		{
+			std::string name = domain_config->get_str();
+			for (PowerDomain *d : this->domains)
+			{
+				if (d->name == name)
+				{
+					d->governed = true;
+					this->new_master_port("frequency_ctrl_" + name, &d->frequency_ctrl_itf);
+				}
+			}
+		}
+	}
 
-	// END GENERATED PORTS
+	js::Config *cap_config = this->get_js_config()->get("power_cap");
+	if (cap_config != NULL && this->opps.size() > 0)
+	{
+		this->capping = true;
+		this->chip_budget = cap_config->get("chip")->get_double();
+		this->cap_period = cap_config->get_child_int("period");
+		this->cap_release = cap_config->get("release")->get_double();
+		this->nominal_voltage = cap_config->get("nominal_voltage")->get_double();
+		for (auto &budget : cap_config->get("domains")->get_childs())
+		{
+			for (PowerDomain *d : this->domains)
+			{
+				if (d->name == budget.first)
+					d->budget = budget.second->get_double();
+			}
+		}
+		for (js::Config *domain_config : cap_config->get("throttle_order")->get_elems())
+		{
+			for (unsigned int i = 0; i < this->domains.size(); i++)
+			{
+				if (this->domains[i]->name == domain_config->get_str())
+					this->throttle_order.push_back(i);
+			}
+		}
+	}
+
+	js::Config *telemetry_config = this->get_js_config()->get("telemetry");
+	if (telemetry_config != NULL && telemetry_config->get_str() != "")
+	{
+		std::string path = telemetry_config->get_str();
+		if (this->domains.size() > PM_TELEMETRY_MAX_DOMAINS || this->states.size() > PM_TELEMETRY_MAX_STATES)
+			this->trace.fatal("The telemetry supports at most %d domains and %d states\n", PM_TELEMETRY_MAX_DOMAINS, PM_TELEMETRY_MAX_STATES);
+		this->telemetry = pm_telemetry_open(path, true);
+		if (this->telemetry == NULL)
+			this->trace.fatal("Couldn't create telemetry file %s\n", path.c_str());
+		this->telemetry->nb_domains = this->domains.size();
+		this->telemetry->nb_states = this->states.size();
+		for (unsigned int i = 0; i < this->states.size(); i++)
+			strncpy(this->telemetry->states[i], this->states[i].name.c_str(), PM_TELEMETRY_NAME_SIZE - 1);
+		for (unsigned int i = 0; i < this->domains.size(); i++)
+			strncpy(this->telemetry->domains[i].name, this->domains[i]->name.c_str(), PM_TELEMETRY_NAME_SIZE - 1);
+		this->telemetry->magic = PM_TELEMETRY_MAGIC;
+	}
 }
 
-// GENERATED EVENT HANDLERS
-void PowerManager::host_delay_handler(vp::Block *__this, vp::TimeEvent *event)
+void PowerManager::reset(bool active)
 {
-	PowerManager *_this = (PowerManager *)__this;
-	_this->power_ctrl_itf_host.sync(_this->host_next_state);
-	_this->trace.msg(vp::TraceLevel::DEBUG, "switching power state of host to %s\n", statename[_this->host_next_state]);
-_this->host_state.set(_this->host_next_state);
+	if (!active)
+	{
+		for (unsigned int i = 0; i < this->domains.size(); i++)
+			this->update_telemetry(i);
+	}
+	if (!active && this->opps.size() > 0)
+	{
+		// governed domains start at the highest operating point
+		for (unsigned int i = 0; i < this->domains.size(); i++)
+		{
+			this->domains[i]->opp = this->domains[i]->opp_cap = this->opps.size() - 1;
+			if (this->domains[i]->governed)
+				this->set_opp(i, this->opps.size() - 1);
+		}
+	}
+	if (!active && this->governor)
+		this->governor_event.enqueue(this->governor_period);
+	if (!active && this->capping)
+		this->cap_event.enqueue(this->cap_period);
+	if (!active && this->channel != NULL && !this->controller_detached)
+	{
+		this->epoch = 0;
+		this->epoch_event.enqueue(this->epoch_period);
+	}
 }
-void PowerManager::sensor1_delay_handler(vp::Block *__this, vp::TimeEvent *event)
+
+int PowerManager::find_state(std::string name)
 {
-	PowerManager *_this = (PowerManager *)__this;
-	_this->power_ctrl_itf_sensor1.sync(_this->sensor1_next_state);
-	_this->trace.msg(vp::TraceLevel::DEBUG, "switching power state of sensor1 to %s\n", statename[_this->sensor1_next_state]);
-_this->sensor1_state.set(_this->sensor1_next_state);
+	for (unsigned int i = 0; i < this->states.size(); i++)
+	{
+		if (this->states[i].name == name)
+			return i;
+	}
+	return -1;
 }
-void PowerManager::sensor2_delay_handler(vp::Block *__this, vp::TimeEvent *event)
+
+// The 4 legacy registers (on-off, off-on, on-cg, cg-on) update the matching
+// entries of the latency matrix between the off, on_clock_gated and on states
+void PowerManager::set_legacy_delay(PowerDomain *d, int reg, unsigned int value)
 {
-	PowerManager *_this = (PowerManager *)__this;
-	_this->power_ctrl_itf_sensor2.sync(_this->sensor2_next_state);
-	_this->trace.msg(vp::TraceLevel::DEBUG, "switching power state of sensor2 to %s\n", statename[_this->sensor2_next_state]);
-_this->sensor2_state.set(_this->sensor2_next_state);
+	int legacy_states[] = {this->state_off, this->state_cg, this->state_on};
+
+	for (int from : legacy_states)
+	{
+		if (from < 0)
+			continue;
+		if (reg == 0 && this->state_off >= 0)
+			d->latency[from][this->state_off] = value;
+		else if (reg == 1 && from == this->state_off && this->state_on >= 0)
+			d->latency[from][this->state_on] = value;
+		else if (reg == 2 && this->state_cg >= 0)
+			d->latency[from][this->state_cg] = value;
+		else if (reg == 3 && from != this->state_off && this->state_on >= 0)
+			d->latency[from][this->state_on] = value;
+	}
+	PM_TRACE(this->trace, "New legacy delay %d of %s: %d\n", reg, d->name.c_str(), value);
 }
-void PowerManager::sensor3_delay_handler(vp::Block *__this, vp::TimeEvent *event)
+
+// Power of a domain estimated from its state and voltage: the leakage left
+// while the supply is off, and otherwise the leakage scaled by the voltage plus,
+// while on, the dynamic power scaled by its square. A component reporting its
+// mode gives instead the power of that mode, clock gated modes included.
+double PowerManager::estimated_power(PowerDomain *d)
 {
-	PowerManager *_this = (PowerManager *)__this;
-	_this->power_ctrl_itf_sensor3.sync(_this->sensor3_next_state);
-	_this->trace.msg(vp::TraceLevel::DEBUG, "switching power state of sensor3 to %s\n", statename[_this->sensor3_next_state]);
-_this->sensor3_state.set(_this->sensor3_next_state);
+	power_state &state = this->states[d->state.get()];
+	if (state.supply == OFF)
+		return d->leakage * state.leakage;
+
+	double scale = d->voltage.get() / this->nominal_voltage;
+	double power = d->leakage * scale;
+	if (d->mode_power.size() > 0)
+	{
+		if (d->mode >= 0 && d->mode < (int)d->mode_power.size())
+			power += d->mode_power[d->mode] * scale * scale;
+	}
+	else if (state.supply == ON)
+		power += d->dynamic * scale * scale;
+	return power;
 }
 
-// END EVENT HANDLERS
+// Accounts the leakage left in the domains whose supply is off and the losses of
+// the shared regulators, up to the current time. The estimated energy of each
+// domain is also integrated, for power capping and for the load of the rails.
+void PowerManager::account_leakage()
+{
+	int64_t now = this->time.get_time();
+	std::vector<double> rail_loads(this->rails.size(), 0.0);
+	for (PowerDomain *d : this->domains)
+	{
+		power_state &state = this->states[d->state.get()];
+		double duration = (now - d->state_since) * 1e-12;
+		double power = this->estimated_power(d);
+		if (state.supply == OFF)
+		{
+			this->pm_energy += power * duration;
+			d->pm_energy += power * duration;
+		}
+		else if (state.supply == ON)
+			d->active_time += now - d->state_since;
+		if (d->has_busy && state.supply != OFF)
+		{
+			// a clock gated core is idle whatever its busy status
+			double cycles = duration * this->domain_frequency(d);
+			if (d->busy && state.supply == ON)
+			{
+				d->busy_cycles += cycles;
+				d->busy_time += now - d->state_since;
+			}
+			else
+				d->idle_cycles += cycles;
+		}
+		d->est_energy += power * duration;
+		if (d->rail >= 0)
+			rail_loads[d->rail] += power;
+		d->state_since = now;
+	}
 
-vp::IoReqStatus PowerManager::handle_state(vp::Block *__this, vp::IoReq *req)
+	for (unsigned int i = 0; i < this->rails.size(); i++)
+	{
+		PowerRail *rail = this->rails[i];
+		double energy = this->rail_loss(rail, rail_loads[i]) * (now - rail->since) * 1e-12;
+		this->pm_energy += energy;
+		rail->loss_energy += energy;
+		rail->since = now;
+	}
+}
+
+double PowerManager::inrush_current(PowerDomain *d, int64_t time)
 {
-	PowerManager *_this = (PowerManager *)__this;
-	_this->trace.msg(vp::TraceLevel::DEBUG, "Received power state request at offset 0x%lx, size 0x%lx, is_write %d\n",
-					 req->get_addr(), req->get_size(), req->get_is_write());
+	if (d->inrush_start < 0 || time >= d->inrush_start + d->inrush_duration)
+		return 0.0;
+	return d->inrush_current * (1.0 - (double)(time - d->inrush_start) / d->inrush_duration);
+}
 
-	if (req->get_is_write())
+// Current delivered by a rail: the load current of its domains plus their in-rush
+double PowerManager::rail_current(PowerRail *rail, int64_t time)
+{
+	double current = 0.0;
+	for (int member : rail->domains)
+	{
+		PowerDomain *d = this->domains[member];
+		if (rail->voltage.get() > 0.0)
+			current += this->estimated_power(d) / rail->voltage.get();
+		current += this->inrush_current(d, time);
+	}
+	return current;
+}
+
+// Time to wait before powering up a domain so that its in-rush fits in the
+// current limit of its rail, 0 if it fits or cannot fit anyway. Violations are
+// reported when the transitions are not serialized.
+int64_t PowerManager::inrush_delay(int domain)
+{
+	PowerDomain *d = this->domains[domain];
+	PowerRail *rail = this->rails[d->rail];
+	int64_t now = this->time.get_time();
+
+	if (rail->max_current <= 0.0 || this->rail_current(rail, now) + d->inrush_current <= rail->max_current)
+		return 0;
+
+	// the current only decreases when the in-rush of another domain is over
+	int64_t delay = 0;
+	for (int member : rail->domains)
+	{
+		PowerDomain *other = this->domains[member];
+		int64_t end = other->inrush_start + other->inrush_duration;
+		if (other->inrush_start >= 0 && end > now && (delay == 0 || end - now < delay))
+			delay = end - now;
+	}
+
+	if (this->serialize_inrush && delay > 0)
+		return delay;
+
+	rail->inrush_violations++;
+	fprintf(stderr, "@power.inrush_violation_%ld@%s@%s@%f@\n", now, rail->name.c_str(), d->name.c_str(),
+			this->rail_current(rail, now) + d->inrush_current);
+	return 0;
+}
+
+// Peaks of the instantaneous power and current, which are reached when a
+// domain is switched on or a voltage raised, since in-rush only decays
+void PowerManager::track_peaks()
+{
+	int64_t now = this->time.get_time();
+	double chip_power = 0.0;
+
+	for (PowerDomain *d : this->domains)
+		chip_power += this->estimated_power(d) + this->inrush_current(d, now) * d->voltage.get();
+	this->chip_peak_inst_power = std::max(this->chip_peak_inst_power, chip_power);
+
+	for (PowerRail *rail : this->rails)
+	{
+		double current = this->rail_current(rail, now);
+		rail->peak_current = std::max(rail->peak_current, current);
+		rail->peak_power = std::max(rail->peak_power, current * rail->voltage.get());
+	}
+}
+
+// Power lost by a regulator delivering the given load power
+double PowerManager::rail_loss(PowerRail *rail, double load)
+{
+	double quiescent = rail->quiescent_current * rail->input_voltage;
+	if (rail->voltage.get() <= 0.0)
+		return quiescent;
+
+	double current = load / rail->voltage.get();
+	if (rail->ldo)
+		return current * rail->input_voltage - load + quiescent;
+
+	// linear interpolation of the efficiency curve, constant beyond its ends
+	double efficiency = rail->efficiency.front().second;
+	for (unsigned int i = 0; i < rail->efficiency.size(); i++)
 	{
-		_this->trace.msg(vp::TraceLevel::DEBUG, "handling power state request...\n");
-		int reqstate = (*req->get_data()) & 3;
-		int power_state;
-		switch (reqstate)
+		std::pair<double, double> &point = rail->efficiency[i];
+		if (current >= point.first)
+			efficiency = point.second;
+		else
 		{
-		case 0:
-			power_state = OFF;
-			break;
-		case 1:
-			power_state = ON_CLOCK_GATED;
-			break;
-		case 2:
-			power_state = OFF;
-			break;
-		case 3:
-			power_state = ON;
-			break;
-		default:
+			if (i > 0)
+			{
+				std::pair<double, double> &prev = rail->efficiency[i - 1];
+				efficiency = prev.second + (point.second - prev.second) * (current - prev.first) / (point.first - prev.first);
+			}
 			break;
 		}
+	}
+	return load / efficiency - load + quiescent;
+}
 
-		int addr = req->get_addr();
+// GVSoC propagates the supply of a component to the components it contains, so
+// after a domain moved to state, the nested children whose state was applied by
+// the manager get their own supply back, while the others take the state of
+// their parent, which they just received
+void PowerManager::resync_nested(int domain, int state)
+{
+	for (int child : this->domains[domain]->children)
+	{
+		PowerDomain *child_domain = this->domains[child];
+		if (!child_domain->nested)
+			continue;
 
-		unsigned int picoseconds = 0;
-		switch (addr)
+		if (child_domain->pm_set)
 		{
-			// GENERATED DELAY OFFSETS
+			child_domain->power_ctrl_itf.sync(this->states[child_domain->state.get()].supply);
+			this->resync_nested(child, child_domain->state.get());
+		}
+		else
+		{
+			child_domain->state.set(state);
+			this->update_telemetry(child);
+			this->resync_nested(child, state);
+		}
+	}
+}
 
-        case 0:
-			if (!_this->delay_host.is_enqueued())
-			{
-				_this->host_next_state = power_state;
-				// if next state is on check previous state
-				if (power_state == ON)
-				{
-					if (_this->host_state.get() == OFF)
-						picoseconds = _this->host_delays[1];//off-on
-					else
-						picoseconds = _this->host_delays[3];//cg-on
-				}
-				else if (power_state == OFF)
-				{
-					picoseconds = _this->host_delays[0];//on-off
-				}
-				else
-					picoseconds = _this->host_delays[2];//on-cg
+// true if all the children of the domain are unpowered and no transition is in
+// progress, the children following the domain go down with it
+bool PowerManager::children_off(int domain)
+{
+	for (int child : this->domains[domain]->children)
+	{
+		PowerDomain *child_domain = this->domains[child];
+		if (this->follows_parent(child_domain))
+			continue;
+		if (this->is_powered(child_domain->state.get()) || child_domain->event.is_enqueued())
+			return false;
+	}
+	return true;
+}
 
-				_this->delay_host.enqueue(picoseconds);
-			}
-			else
-				_this->trace.msg(vp::TraceLevel::DEBUG, "Last change of host is still  in progress...\n");
-			break;
+void PowerManager::start_transition(int domain, int state, unsigned int extra_delay)
+{
+	PowerDomain *d = this->domains[domain];
+	if (d->event.is_enqueued())
+	{
+		// applied once the current transition is over
+		d->pending_state = state;
+		return;
+	}
 
-        case 4:
-			if (!_this->delay_sensor1.is_enqueued())
-			{
-				_this->sensor1_next_state = power_state;
-				// if next state is on check previous state
-				if (power_state == ON)
-				{
-					if (_this->sensor1_state.get() == OFF)
-						picoseconds = _this->sensor1_delays[1];//off-on
-					else
-						picoseconds = _this->sensor1_delays[3];//cg-on
-				}
-				else if (power_state == OFF)
-				{
-					picoseconds = _this->sensor1_delays[0];//on-off
-				}
-				else
-					picoseconds = _this->sensor1_delays[2];//on-cg
+	d->next_state = state;
+	d->pending_state = -1;
+	d->event.enqueue(d->latency[d->state.get()][state] + extra_delay);
+}
 
-				_this->delay_sensor1.enqueue(picoseconds);
-			}
-			else
-				_this->trace.msg(vp::TraceLevel::DEBUG, "Last change of sensor1 is still  in progress...\n");
-			break;
+// Moves a domain to a state, respecting the dependencies with its parent and children
+void PowerManager::set_target_state(int domain, int state)
+{
+	PowerDomain *d = this->domains[domain];
 
-        case 8:
-			if (!_this->delay_sensor2.is_enqueued())
+	if (!this->is_powered(state))
+	{
+		// children are moved to the same unpowered state first, the domain follows
+		// once the last one is done
+		for (int child : d->children)
+		{
+			PowerDomain *child_domain = this->domains[child];
+			if (this->follows_parent(child_domain))
+				continue;
+			if (child_domain->event.is_enqueued())
 			{
-				_this->sensor2_next_state = power_state;
-				// if next state is on check previous state
-				if (power_state == ON)
-				{
-					if (_this->sensor2_state.get() == OFF)
-						picoseconds = _this->sensor2_delays[1];//off-on
-					else
-						picoseconds = _this->sensor2_delays[3];//cg-on
-				}
-				else if (power_state == OFF)
-				{
-					picoseconds = _this->sensor2_delays[0];//on-off
-				}
-				else
-					picoseconds = _this->sensor2_delays[2];//on-cg
-
-				_this->delay_sensor2.enqueue(picoseconds);
+				if (this->is_powered(child_domain->next_state))
+					child_domain->pending_state = state;
+			}
+			else if (this->is_powered(child_domain->state.get()))
+			{
+				this->set_target_state(child, state);
 			}
 			else
-				_this->trace.msg(vp::TraceLevel::DEBUG, "Last change of sensor2 is still  in progress...\n");
-			break;
-
-        case 12:
-			if (!_this->delay_sensor3.is_enqueued())
 			{
-				_this->sensor3_next_state = power_state;
-				// if next state is on check previous state
-				if (power_state == ON)
-				{
-					if (_this->sensor3_state.get() == OFF)
-						picoseconds = _this->sensor3_delays[1];//off-on
-					else
-						picoseconds = _this->sensor3_delays[3];//cg-on
-				}
-				else if (power_state == OFF)
-				{
-					picoseconds = _this->sensor3_delays[0];//on-off
-				}
-				else
-					picoseconds = _this->sensor3_delays[2];//on-cg
-
-				_this->delay_sensor3.enqueue(picoseconds);
+				child_domain->pending_state = -1;
 			}
+		}
+
+		if (!this->children_off(domain))
+		{
+			PM_TRACE(this->trace, "%s waits for its children to be off\n", d->name.c_str());
+			d->pending_state = state;
+			return;
+		}
+	}
+	else if (d->parent >= 0)
+	{
+		PowerDomain *parent = this->domains[d->parent];
+		bool parent_powered = this->is_powered(parent->state.get()) &&
+							  !(parent->event.is_enqueued() && !this->is_powered(parent->next_state));
+
+		if (parent->pending_state != -1 && !this->is_powered(parent->pending_state))
+			parent->pending_state = -1;
+
+		if (!parent_powered)
+		{
+			PM_TRACE(this->trace, "%s waits for %s to be powered\n", d->name.c_str(), parent->name.c_str());
+			d->pending_state = state;
+			if (parent->event.is_enqueued())
+				parent->pending_state = this->state_on;
 			else
-				_this->trace.msg(vp::TraceLevel::DEBUG, "Last change of sensor3 is still  in progress...\n");
-			break;
+				this->set_target_state(d->parent, this->state_on);
+			return;
+		}
+	}
 
-			// END GENERATED DELAY OFFSETS
+	this->start_transition(domain, state, 0);
+}
+
+void PowerManager::domain_delay_handler(vp::Block *__this, vp::TimeEvent *event)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	int domain;
 
-		default:
-			_this->trace.msg(vp::TraceLevel::DEBUG, "No component associated with offset %d\n", addr);
+	for (domain = 0; domain < (int)_this->domains.size(); domain++)
+	{
+		if (&_this->domains[domain]->event == event)
 			break;
+	}
+
+	PowerDomain *d = _this->domains[domain];
+	int prev_state = d->state.get();
+	power_state &state = _this->states[d->next_state];
+	bool power_up = _this->states[prev_state].supply == OFF && state.supply != OFF;
+
+	if (power_up && d->rail >= 0)
+	{
+		int64_t delay = _this->inrush_delay(domain);
+		if (delay > 0)
+		{
+			PM_TRACE(_this->trace, "delaying power-up of %s by %ld ps to limit the in-rush of rail %s\n",
+					 d->name.c_str(), delay, _this->rails[d->rail]->name.c_str());
+			d->event.enqueue(delay);
+			return;
+		}
+	}
+
+	_this->account_leakage();
+	_this->pm_energy += d->energy[prev_state][d->next_state] * 1e-12;
+	d->pm_energy += d->energy[prev_state][d->next_state] * 1e-12;
+	d->transition_energy += d->energy[prev_state][d->next_state] * 1e-12;
+
+	if (power_up && d->inrush_current > 0.0)
+	{
+		// energy of the triangular current profile at the domain voltage
+		double energy = 0.5 * d->inrush_current * d->voltage.get() * d->inrush_duration * 1e-12;
+		_this->pm_energy += energy;
+		d->pm_energy += energy;
+		d->est_energy += energy;
+		d->inrush_start = _this->time.get_time();
+	}
+
+	d->power_ctrl_itf.sync(state.supply);
+	d->pm_set = true;
+	_this->resync_nested(domain, d->next_state);
+	PM_TRACE(_this->trace, "switching power state of %s to %s\n", d->name.c_str(), state.name.c_str());
+	if (!_this->states[prev_state].retention && _this->is_powered(d->next_state) && !_this->is_powered(prev_state))
+		PM_TRACE(_this->trace, "context of %s was lost in state %s\n", d->name.c_str(), _this->states[prev_state].name.c_str());
+	d->state.set(d->next_state);
+	_this->update_telemetry(domain);
+	_this->track_peaks();
+
+	if (d->pending_state != -1)
+	{
+		int pending_state = d->pending_state;
+		d->pending_state = -1;
+		if (pending_state != d->next_state)
+			_this->set_target_state(domain, pending_state);
+	}
+
+	if (state.supply == ON)
+		_this->release_stalled(domain);
+
+	if (_this->is_powered(d->next_state))
+	{
+		// power up the children which were waiting for this domain
+		for (int child : d->children)
+		{
+			PowerDomain *child_domain = _this->domains[child];
+			if (child_domain->pending_state != -1 && _this->is_powered(child_domain->pending_state) && !child_domain->event.is_enqueued())
+				_this->start_transition(child, child_domain->pending_state, child_domain->edge_delay);
 		}
 	}
+	else if (d->parent >= 0)
+	{
+		// the parent may be waiting for its last child to be off
+		PowerDomain *parent = _this->domains[d->parent];
+		if (parent->pending_state != -1 && !_this->is_powered(parent->pending_state) && !parent->event.is_enqueued() &&
+			_this->children_off(d->parent))
+			_this->start_transition(d->parent, parent->pending_state, 0);
+	}
+}
+
+vp::IoReqStatus PowerManager::handle_state(vp::Block *__this, vp::IoReq *req)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	PM_TRACE(_this->trace, "Received power state request at offset 0x%lx, size 0x%lx, is_write %d\n",
+					 req->get_addr(), req->get_size(), req->get_is_write());
+
+	if (req->get_is_write())
+	{
+		PM_TRACE(_this->trace, "handling power state request...\n");
+		unsigned int power_state = *(uint32_t *)req->get_data();
+		unsigned int domain = req->get_addr() / 4;
+
+		if (power_state >= _this->states.size())
+			PM_TRACE(_this->trace, "Unknown power state %d\n", power_state);
+		else if (domain < _this->domains.size())
+		{
+			// the firmware takes back the control of the domain
+			_this->domains[domain]->auto_gated = false;
+			if (!_this->domains[domain]->event.is_enqueued())
+				_this->set_target_state(domain, power_state);
+			else
+				PM_TRACE(_this->trace, "Last change of %s is still  in progress...\n", _this->domains[domain]->name.c_str());
+		}
+		else
+			PM_TRACE(_this->trace, "No component associated with offset %d\n", req->get_addr());
+	}
 	return vp::IoReqStatus::IO_REQ_OK;
 }
 
 vp::IoReqStatus PowerManager::handle_voltage(vp::Block *__this, vp::IoReq *req)
 {
 	PowerManager *_this = (PowerManager *)__this;
-	_this->trace.msg(vp::TraceLevel::DEBUG, "Received voltage request at offset 0x%lx, size 0x%lx, is_write %d\n", req->get_addr(), req->get_size(), req->get_is_write());
+	PM_TRACE(_this->trace, "Received voltage request at offset 0x%lx, size 0x%lx, is_write %d\n", req->get_addr(), req->get_size(), req->get_is_write());
 
 	if (req->get_is_write())
 	{
 		float voltage = (*(float *)req->get_data());
-		_this->trace.msg(vp::TraceLevel::DEBUG, "handling voltage request with %f...\n", voltage);
+		PM_TRACE(_this->trace, "handling voltage request with %f...\n", voltage);
 
 		_this->to_change.address = req->get_addr();
 		_this->to_change.voltage = voltage;
@@ -317,7 +1051,7 @@ vp::IoReqStatus PowerManager::handle_voltage(vp::Block *__this, vp::IoReq *req)
 		if (!_this->delay_voltage.is_enqueued()){
 			_this->delay_voltage.enqueue(_this->delay_voltage_value);
 		}else
-		_this->trace.msg(vp::TraceLevel::DEBUG, "Request ignored, another voltage request is in progress....\n");		
+		PM_TRACE(_this->trace, "Request ignored, another voltage request is in progress....\n");
 	}
 
 	return vp::IoReqStatus::IO_REQ_OK;
@@ -326,56 +1060,34 @@ vp::IoReqStatus PowerManager::handle_voltage(vp::Block *__this, vp::IoReq *req)
 vp::IoReqStatus PowerManager::handle_state_delay_config(vp::Block *__this, vp::IoReq *req)
 {
 	PowerManager *_this = (PowerManager *)__this;
-	_this->trace.msg(vp::TraceLevel::DEBUG, "Received delay config at offset 0x%lx, size 0x%lx, is_write %d\n", req->get_addr(), req->get_size(), req->get_is_write());
+	PM_TRACE(_this->trace, "Received delay config at offset 0x%lx, size 0x%lx, is_write %d\n", req->get_addr(), req->get_size(), req->get_is_write());
 
 	if (req->get_is_write())
 	{
 		int value = *(uint32_t *)req->get_data();
-		_this->trace.msg(vp::TraceLevel::DEBUG, "handling delay config request...%x\n", value);
+		PM_TRACE(_this->trace, "handling delay config request...%x\n", value);
 
 		int addr = req->get_addr();
+		unsigned int domain = addr / CONFIG_WINDOW_SIZE;
+		unsigned int reg = (addr % CONFIG_WINDOW_SIZE) / 4;
+		unsigned int nb_states = _this->states.size();
 
-		switch (addr)
-		{
-			// GENERATED CONFIG DELAY OFFSETS
-
-        case 0:
-		case 4:
-		case 8:
-		case 12:
-			_this->host_delays[(addr-0)/4] = value;
-			_this->trace.msg(vp::TraceLevel::DEBUG, "New configuration is: on-off: %d, off-on: %d, on-cg: %d, cg-on: %d\n", _this->host_delays[0],_this->host_delays[1],_this->host_delays[2],_this->host_delays[3]);
-		break;
-
-        case 16:
-		case 20:
-		case 24:
-		case 28:
-			_this->sensor1_delays[(addr-16)/4] = value;
-			_this->trace.msg(vp::TraceLevel::DEBUG, "New configuration is: on-off: %d, off-on: %d, on-cg: %d, cg-on: %d\n", _this->sensor1_delays[0],_this->sensor1_delays[1],_this->sensor1_delays[2],_this->sensor1_delays[3]);
-		break;
-
-        case 32:
-		case 36:
-		case 40:
-		case 44:
-			_this->sensor2_delays[(addr-32)/4] = value;
-			_this->trace.msg(vp::TraceLevel::DEBUG, "New configuration is: on-off: %d, off-on: %d, on-cg: %d, cg-on: %d\n", _this->sensor2_delays[0],_this->sensor2_delays[1],_this->sensor2_delays[2],_this->sensor2_delays[3]);
-		break;
-
-        case 48:
-		case 52:
-		case 56:
-		case 60:
-			_this->sensor3_delays[(addr-48)/4] = value;
-			_this->trace.msg(vp::TraceLevel::DEBUG, "New configuration is: on-off: %d, off-on: %d, on-cg: %d, cg-on: %d\n", _this->sensor3_delays[0],_this->sensor3_delays[1],_this->sensor3_delays[2],_this->sensor3_delays[3]);
-		break;
-
-		// END GENERATED CONFIG DELAY OFFSETS
-		default:
-			_this->trace.msg(vp::TraceLevel::DEBUG, "No component associated with offset %d\n", addr);
-			break;
+		if (domain < _this->domains.size())
+		{
+			PowerDomain *d = _this->domains[domain];
+			if (reg < 4)
+			{
+				_this->set_legacy_delay(d, reg, value);
+			}
+			else if (reg - 4 < nb_states * nb_states)
+			{
+				d->latency[(reg - 4) / nb_states][(reg - 4) % nb_states] = value;
+				PM_TRACE(_this->trace, "New latency of %s from %s to %s: %d\n", d->name.c_str(),
+								 _this->states[(reg - 4) / nb_states].name.c_str(), _this->states[(reg - 4) % nb_states].name.c_str(), value);
+			}
 		}
+		else
+			PM_TRACE(_this->trace, "No component associated with offset %d\n", addr);
 	}
 	return vp::IoReqStatus::IO_REQ_OK;
 }
@@ -383,70 +1095,311 @@ vp::IoReqStatus PowerManager::handle_state_delay_config(vp::Block *__this, vp::I
 vp::IoReqStatus PowerManager::handle_power_report(vp::Block *__this, vp::IoReq *req)
 {
 	PowerManager *_this = (PowerManager *)__this;
-	_this->trace.msg(vp::TraceLevel::DEBUG, "Received report request at offset 0x%lx, size 0x%lx, is_write %d\n",
+	PM_TRACE(_this->trace, "Received report request at offset 0x%lx, size 0x%lx, is_write %d\n",
 					 req->get_addr(), req->get_size(), req->get_is_write());
 
-	if (req->get_is_write())
+	if (req->get_is_write() && req->get_addr() == REPORT_MARKER)
+	{
+		_this->signal_marker(*(uint32_t *)req->get_data());
+	}
+	else if (req->get_is_write())
 	{
 		double dynamic_power, static_power;
 		int data = (*req->get_data()) & 1;
 
+		_this->account_leakage();
+
 		if (data == 0)
 		{
 			_this->power.get_engine()->stop_capture();
 			_this->last_power_measure = _this->power.get_engine()->get_average_power(dynamic_power, static_power);
+			int64_t duration = _this->time.get_time() - _this->capture_start_time;
+			if (duration > 0)
+				_this->last_power_measure += (_this->pm_energy - _this->capture_pm_energy) / (duration * 1e-12);
 			fprintf(stderr, "@power.measure_%ld@%f@\n", _this->time.get_time(), _this->last_power_measure);
 		}
 		else if (data == 1)
 		{
 			_this->power.get_engine()->start_capture();
+			_this->capture_pm_energy = _this->pm_energy;
+			_this->capture_start_time = _this->time.get_time();
+			fprintf(stderr, "@power.capture_start_%ld@\n", _this->capture_start_time);
 		}
 	}
 	else
 	{
 		*(double *)req->get_data() = _this->last_power_measure;
-		_this->trace.msg(vp::TraceLevel::DEBUG, "Returning %f\n", _this->last_power_measure);
+		PM_TRACE(_this->trace, "Returning %f\n", _this->last_power_measure);
 	}
 
 	return vp::IoReqStatus::IO_REQ_OK;
 }
 
+// The marker is sent out at address 0, which the launcher can tell apart from
+// the accesses of the core. The launcher replies once it handled the marker, a
+// marker reached before that is dropped since the request is still in flight.
+void PowerManager::signal_marker(uint32_t id)
+{
+	if (!this->marker_itf.is_bound())
+	{
+		PM_TRACE(this->trace, "Ignoring marker %d, no launcher connected\n", id);
+		return;
+	}
+	if (this->marker_pending)
+	{
+		PM_TRACE(this->trace, "Dropping marker %d, marker %d is still handled by the launcher\n", id, this->marker_id);
+		return;
+	}
+
+	PM_TRACE(this->trace, "Reached marker %d\n", id);
+	this->marker_id = id;
+	this->marker_req.init();
+	this->marker_req.set_addr(0);
+	this->marker_req.set_size(sizeof(this->marker_id));
+	this->marker_req.set_is_write(true);
+	this->marker_req.set_data((uint8_t *)&this->marker_id);
+	this->marker_pending = true;
+	if (this->marker_itf.req(&this->marker_req) != vp::IoReqStatus::IO_REQ_PENDING)
+		this->marker_pending = false;
+}
+
+void PowerManager::marker_grant(vp::Block *__this, vp::IoReq *req)
+{
+}
+
+void PowerManager::marker_resp(vp::Block *__this, vp::IoReq *req)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	_this->marker_pending = false;
+}
+
+// Accesses to a domain with wake-on-access go through directly while it is on.
+// Otherwise they are held and the domain is moved to the on state, through its
+// parents if needed, so that the access pays the wake-up latency of the domain.
+vp::IoReqStatus PowerManager::handle_tap(vp::Block *__this, vp::IoReq *req, int domain)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	PowerDomain *d = _this->domains[domain];
+
+	if (d->parent >= 0)
+	{
+		PowerDomain *parent = _this->domains[d->parent];
+		parent->tap_requests++;
+		parent->tap_bytes += req->get_size();
+	}
+
+	if (_this->states[d->state.get()].supply == ON && !d->event.is_enqueued())
+		return _this->forward_tap(domain, req);
+
+	PM_TRACE(_this->trace, "Holding access to %s at 0x%lx until it is on\n", d->name.c_str(), req->get_addr());
+	d->stalled_reqs.push(req);
+
+	if (d->event.is_enqueued())
+	{
+		if (d->next_state != _this->state_on)
+			d->pending_state = _this->state_on;
+	}
+	else if (d->pending_state != _this->state_on)
+	{
+		PM_TRACE(_this->trace, "Waking up %s on access\n", d->name.c_str());
+		_this->set_target_state(domain, _this->state_on);
+	}
+
+	return vp::IoReqStatus::IO_REQ_PENDING;
+}
+
+// The response port of the initiator is kept in the request while it is
+// forwarded, the response of the component is then sent back to it
+vp::IoReqStatus PowerManager::forward_tap(int domain, vp::IoReq *req)
+{
+	req->arg_push(req->get_resp_port());
+	vp::IoReqStatus status = this->domains[domain]->tap_out_itf.req(req);
+	if (status != vp::IoReqStatus::IO_REQ_PENDING)
+		req->arg_pop();
+	return status;
+}
+
+void PowerManager::tap_resp(vp::Block *__this, vp::IoReq *req)
+{
+	vp::IoSlave *resp_port = (vp::IoSlave *)req->arg_pop();
+	resp_port->resp(req);
+}
+
+// The response of a granted request still comes through tap_resp, which owns
+// the argument pushed by forward_tap, so the grant itself is only traced
+void PowerManager::tap_grant(vp::Block *__this, vp::IoReq *req)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	PM_TRACE(_this->trace, "Access at 0x%lx granted\n", req->get_addr());
+}
+
+void PowerManager::release_stalled(int domain)
+{
+	PowerDomain *d = this->domains[domain];
+	while (!d->stalled_reqs.empty())
+	{
+		vp::IoReq *req = d->stalled_reqs.front();
+		d->stalled_reqs.pop();
+		vp::IoSlave *resp_port = req->get_resp_port();
+		vp::IoReqStatus status = this->forward_tap(domain, req);
+		if (status != vp::IoReqStatus::IO_REQ_PENDING)
+		{
+			req->set_resp_status(status);
+			resp_port->resp(req);
+		}
+	}
+}
+
 void PowerManager::voltage_delay_handler(vp::Block *__this, vp::TimeEvent *event)
 {
 	PowerManager *_this = (PowerManager *)__this;
+	unsigned int domain = _this->to_change.address / 4;
 
-	switch (_this->to_change.address)
+	if (domain < _this->domains.size())
+		_this->set_voltage(domain, _this->to_change.voltage);
+	else
+		PM_TRACE(_this->trace, "No component associated with offset %d\n", _this->to_change.address);
+}
+
+// A domain on a shared rail only requests a voltage, the rail delivers the
+// highest one requested by its domains to all of them
+void PowerManager::set_voltage(int domain, float voltage)
+{
+	PowerDomain *d = this->domains[domain];
+	this->account_leakage();
+	d->requested_voltage = voltage;
+	if (d->rail < 0)
 	{
-	// GENERATED VOLTAGE OFFSETS
-		case 0:
-			_this->voltage_ctrl_itf_host.sync(_this->to_change.voltage);
-			_this->trace.msg(vp::TraceLevel::DEBUG, "switching voltage of host to %f\n", _this->to_change.voltage);
-			_this->host_voltage.set(_this->to_change.voltage);
+		this->apply_voltage(domain, voltage);
+		return;
+	}
 
-			break;
-		case 4:
-			_this->voltage_ctrl_itf_sensor1.sync(_this->to_change.voltage);
-			_this->trace.msg(vp::TraceLevel::DEBUG, "switching voltage of sensor1 to %f\n", _this->to_change.voltage);
-			_this->sensor1_voltage.set(_this->to_change.voltage);
+	PowerRail *rail = this->rails[d->rail];
+	float rail_voltage = 0.0;
+	for (int member : rail->domains)
+		rail_voltage = std::max(rail_voltage, this->domains[member]->requested_voltage);
+	if (rail_voltage != rail->voltage.get())
+		PM_TRACE(this->trace, "switching rail %s to %f\n", rail->name.c_str(), rail_voltage);
+	rail->voltage.set(rail_voltage);
+	for (int member : rail->domains)
+	{
+		if (this->domains[member]->voltage.get() != rail_voltage)
+			this->apply_voltage(member, rail_voltage);
+	}
+	this->track_peaks();
+}
 
-			break;
-		case 8:
-			_this->voltage_ctrl_itf_sensor2.sync(_this->to_change.voltage);
-			_this->trace.msg(vp::TraceLevel::DEBUG, "switching voltage of sensor2 to %f\n", _this->to_change.voltage);
-			_this->sensor2_voltage.set(_this->to_change.voltage);
+void PowerManager::apply_voltage(int domain, float voltage)
+{
+	PowerDomain *d = this->domains[domain];
+	d->voltage_ctrl_itf.sync(voltage);
+	PM_TRACE(this->trace, "switching voltage of %s to %f\n", d->name.c_str(), voltage);
+	d->voltage.set(voltage);
+	this->update_telemetry(domain);
+}
 
-			break;
-		case 12:
-			_this->voltage_ctrl_itf_sensor3.sync(_this->to_change.voltage);
-			_this->trace.msg(vp::TraceLevel::DEBUG, "switching voltage of sensor3 to %f\n", _this->to_change.voltage);
-			_this->sensor3_voltage.set(_this->to_change.voltage);
+// Only the entry of the domain which changed is written, between the two
+// updates of the sequence number
+void PowerManager::update_telemetry(int domain)
+{
+	if (this->telemetry == NULL)
+		return;
 
-			break;
+	PowerDomain *d = this->domains[domain];
+	pm_telemetry_domain &entry = this->telemetry->domains[domain];
+	int64_t now = this->time.get_time();
 
-	// END GENERATED VOLTAGE OFFSETS
-	default:
-		_this->trace.msg(vp::TraceLevel::DEBUG, "No component associated with offset %d\n", _this->to_change.address);
-		break;
+	// the energy of the domain as in the power report: its estimated power,
+	// leakage included, and the energy of its transitions
+	this->account_leakage();
+	pm_telemetry_write_begin(this->telemetry);
+	this->telemetry->time = now;
+	entry.state = d->state.get();
+	entry.voltage = d->voltage.get();
+	entry.energy = d->est_energy + d->transition_energy;
+	entry.last_change = now;
+	pm_telemetry_write_end(this->telemetry);
+}
+
+// At each epoch, the observation of all the domains is sent to the controller,
+// and the simulation is held until the controller answers with the action of
+// the same epoch, so that decisions are taken at a fixed simulated time.
+void PowerManager::epoch_handler(vp::Block *__this, vp::TimeEvent *event)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	pm_observation observation;
+
+	_this->account_leakage();
+
+	observation.epoch = _this->epoch;
+	observation.time = _this->time.get_time();
+	observation.nb_domains = _this->domains.size();
+	for (unsigned int i = 0; i < _this->domains.size(); i++)
+	{
+		PowerDomain *d = _this->domains[i];
+		observation.domains[i].state = d->state.get();
+		observation.domains[i].voltage = d->voltage.get();
+		observation.domains[i].on_fraction = (double)(d->active_time - d->epoch_active_time) / _this->epoch_period;
+		observation.domains[i].energy = d->pm_energy;
+		observation.domains[i].counters = _this->sample_activity(i);
+		d->epoch_active_time = d->active_time;
+	}
+
+	pm_action action;
+	if (!_this->channel->observations.push(observation))
+		PM_TRACE(_this->trace, "Controller channel full, dropping epoch %lu\n", _this->epoch);
+	else if (_this->wait_action(action))
+	{
+		for (unsigned int i = 0; i < _this->domains.size(); i++)
+		{
+			pm_domain_action &domain_action = action.domains[i];
+			if (domain_action.state >= 0 && domain_action.state < (int)_this->states.size() &&
+				domain_action.state != _this->domains[i]->state.get())
+			{
+				if (!_this->domains[i]->event.is_enqueued())
+					_this->set_target_state(i, domain_action.state);
+				else
+					PM_TRACE(_this->trace, "Last change of %s is still  in progress...\n", _this->domains[i]->name.c_str());
+			}
+			if (domain_action.voltage > 0)
+				_this->set_voltage(i, domain_action.voltage);
+		}
+	}
+	else
+	{
+		// A controller which misses one epoch is most likely gone, waiting
+		// again at each epoch would stall the simulation for nothing, so the
+		// manager goes on alone with the decisions of the firmware.
+		fprintf(stderr, "PowerManager: no action from the controller for epoch %lu after %ld ms, detaching it\n",
+			_this->epoch, _this->controller_timeout);
+		_this->controller_detached = true;
+		return;
+	}
+
+	_this->epoch++;
+	_this->epoch_event.enqueue(_this->epoch_period);
+}
+
+// Returns the action of the current epoch, actions of past epochs which arrive
+// late are dropped. The wait spins first, since the controller usually answers
+// within microseconds, then yields the host core.
+bool PowerManager::wait_action(pm_action &action)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int spin = 0;; spin++)
+	{
+		while (this->channel->actions.pop(action))
+		{
+			if (action.epoch == this->epoch)
+				return true;
+		}
+
+		if (spin >= 1000)
+		{
+			sched_yield();
+			if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(this->controller_timeout))
+				return false;
+		}
 	}
 }
 
@@ -454,7 +1407,353 @@ void PowerManager::voltage_delay_handler(vp::Block *__this, vp::TimeEvent *event
 {
 	PowerManager *_this = (PowerManager *)__this;
 	_this->delay_voltage_value = *((uint32_t *)req->get_data());
-	_this->trace.msg(vp::TraceLevel::DEBUG, "delay of voltage change set to  %d\n", _this->delay_voltage_value);
+	PM_TRACE(_this->trace, "delay of voltage change set to  %d\n", _this->delay_voltage_value);
+	return vp::IoReqStatus::IO_REQ_OK;
+}
+
+// Load of a domain over the last governor period: the fraction of the period
+// its core was busy if the manager gets its busy status, its busy cycles over
+// the cycles of its clock if its component reports activity, and otherwise the
+// fraction of the period it spent with the supply on
+double PowerManager::domain_load(int domain)
+{
+	PowerDomain *d = this->domains[domain];
+	int64_t active_time = d->active_time - d->gov_active_time;
+	d->gov_active_time = d->active_time;
+
+	if (d->has_busy)
+	{
+		int64_t busy_time = d->busy_time - d->gov_busy_time;
+		d->gov_busy_time = d->busy_time;
+		return std::min((double)busy_time / this->governor_period, 1.0);
+	}
+
+	if (d->activity == NULL)
+		return (double)active_time / this->governor_period;
+
+	uint64_t busy_cycles = d->activity->busy_cycles - d->gov_busy_cycles;
+	d->gov_busy_cycles = d->activity->busy_cycles;
+	double period_cycles = this->governor_period * 1e-12 * this->domain_frequency(d);
+	return period_cycles > 0 ? std::min(busy_cycles / period_cycles, 1.0) : 0.0;
+}
+
+void PowerManager::set_opp(int domain, int opp)
+{
+	PowerDomain *d = this->domains[domain];
+	d->opp = opp;
+	this->set_voltage(domain, this->opps[opp].voltage);
+	d->frequency.set(this->opps[opp].frequency);
+	if (d->frequency_ctrl_itf.is_bound())
+		d->frequency_ctrl_itf.set_frequency(this->opps[opp].frequency);
+}
+
+// Ondemand jumps to the highest operating point as soon as the load is above
+// up_threshold, conservative steps up one point at a time. Both step down one
+// point after down_samples periods in a row below down_threshold, the gap
+// between the two thresholds giving the hysteresis.
+void PowerManager::governor_handler(vp::Block *__this, vp::TimeEvent *event)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	int max_opp = _this->opps.size() - 1;
+
+	_this->account_leakage();
+
+	for (unsigned int i = 0; i < _this->domains.size(); i++)
+	{
+		PowerDomain *d = _this->domains[i];
+		if (!d->governed)
+			continue;
+
+		double load = _this->domain_load(i);
+		// the voltage of an unpowered domain is left to the firmware
+		if (!_this->is_powered(d->state.get()) || d->event.is_enqueued())
+			continue;
+
+		int opp = d->opp;
+		if (load > _this->up_threshold)
+		{
+			d->low_samples = 0;
+			opp = _this->governor_ondemand ? max_opp : std::min(opp + 1, max_opp);
+		}
+		else if (load < _this->down_threshold && ++d->low_samples >= _this->down_samples)
+		{
+			d->low_samples = 0;
+			opp = std::max(opp - 1, 0);
+		}
+		else if (load >= _this->down_threshold)
+			d->low_samples = 0;
+		opp = std::min(opp, d->opp_cap);
+
+		if (opp != d->opp)
+		{
+			PM_TRACE(_this->trace, "Governor moves %s to %fV at load %f\n", d->name.c_str(), _this->opps[opp].voltage, load);
+			_this->set_opp(i, opp);
+		}
+	}
+
+	_this->governor_event.enqueue(_this->governor_period);
+}
+
+void PowerManager::set_opp_cap(int domain, int opp_cap)
+{
+	PowerDomain *d = this->domains[domain];
+	PM_TRACE(this->trace, "Power cap limits %s to %fV\n", d->name.c_str(), this->opps[opp_cap].voltage);
+	d->opp_cap = opp_cap;
+	if (d->opp > opp_cap || !d->governed)
+		this->set_opp(domain, opp_cap);
+}
+
+// Lowers the operating point of the lowest priority domain which can still be
+// lowered, or once they are all at the lowest one, clock gates the lowest
+// priority domain still on. Returns false if nothing is left to throttle.
+bool PowerManager::throttle_chip()
+{
+	for (int domain : this->throttle_order)
+	{
+		PowerDomain *d = this->domains[domain];
+		if (d->opp_cap > 0 && this->is_powered(d->state.get()))
+		{
+			this->set_opp_cap(domain, d->opp_cap - 1);
+			return true;
+		}
+	}
+	for (int domain : this->throttle_order)
+	{
+		PowerDomain *d = this->domains[domain];
+		if (this->states[d->state.get()].supply == ON && !d->event.is_enqueued() && this->state_cg >= 0)
+		{
+			PM_TRACE(this->trace, "Power cap clock gates %s\n", d->name.c_str());
+			d->cap_gated = true;
+			this->set_target_state(domain, this->state_cg);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Undoes one throttling step, in the reverse order
+bool PowerManager::release_chip()
+{
+	int max_opp = this->opps.size() - 1;
+	for (auto it = this->throttle_order.rbegin(); it != this->throttle_order.rend(); it++)
+	{
+		PowerDomain *d = this->domains[*it];
+		if (d->cap_gated && !d->event.is_enqueued())
+		{
+			d->cap_gated = false;
+			if (d->state.get() == this->state_cg)
+				this->set_target_state(*it, this->state_on);
+			return true;
+		}
+	}
+	for (auto it = this->throttle_order.rbegin(); it != this->throttle_order.rend(); it++)
+	{
+		PowerDomain *d = this->domains[*it];
+		double budget_power = (d->est_energy - d->window_energy) / (this->cap_period * 1e-12);
+		if (d->opp_cap < max_opp && (d->budget == 0.0 || budget_power < d->budget * this->cap_release))
+		{
+			this->set_opp_cap(*it, d->opp_cap + 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+// At the end of each window, the power of each domain over the window is
+// compared to its budget, and the sum to the chip budget. A domain over its
+// budget has its operating point lowered, the chip over its budget throttles
+// the lowest priority domains first. Throttling is released one step per
+// window once all the powers are below cap_release times their budget.
+void PowerManager::cap_handler(vp::Block *__this, vp::TimeEvent *event)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	double window = _this->cap_period * 1e-12;
+	double total_power = 0.0;
+	bool violation = false;
+	bool release = true;
+
+	_this->account_leakage();
+
+	std::vector<double> powers;
+	for (PowerDomain *d : _this->domains)
+	{
+		double power = (d->est_energy - d->window_energy) / window;
+		powers.push_back(power);
+		total_power += power;
+		d->peak_power = std::max(d->peak_power, power);
+		if (d->cap_gated || d->opp_cap < (int)_this->opps.size() - 1)
+			d->throttled_time += _this->cap_period;
+	}
+	_this->chip_power.set(total_power);
+	_this->chip_peak_power = std::max(_this->chip_peak_power, total_power);
+
+	for (unsigned int i = 0; i < _this->domains.size(); i++)
+	{
+		PowerDomain *d = _this->domains[i];
+		if (d->budget > 0.0 && powers[i] > d->budget)
+		{
+			violation = true;
+			d->violations++;
+			fprintf(stderr, "@power.cap_violation_%ld@%s@%f@\n", _this->time.get_time(), d->name.c_str(), powers[i]);
+			if (d->opp_cap > 0)
+				_this->set_opp_cap(i, d->opp_cap - 1);
+		}
+		else if (d->budget > 0.0 && powers[i] > d->budget * _this->cap_release)
+			release = false;
+	}
+
+	if (_this->chip_budget > 0.0 && total_power > _this->chip_budget)
+	{
+		violation = true;
+		_this->chip_violations++;
+		fprintf(stderr, "@power.cap_violation_%ld@chip@%f@\n", _this->time.get_time(), total_power);
+		if (!_this->throttle_chip())
+			PM_TRACE(_this->trace, "Power cap: nothing left to throttle\n");
+	}
+	else if (_this->chip_budget > 0.0 && total_power > _this->chip_budget * _this->cap_release)
+		release = false;
+
+	if (!violation && release)
+		_this->release_chip();
+
+	for (PowerDomain *d : _this->domains)
+		d->window_energy = d->est_energy;
+
+	_this->cap_event.enqueue(_this->cap_period);
+}
+
+void PowerManager::stop()
+{
+	int64_t now = this->time.get_time();
+
+	this->account_leakage();
+	fprintf(stderr, "Chip peak instantaneous power: %f W\n", this->chip_peak_inst_power);
+	for (PowerRail *rail : this->rails)
+	{
+		fprintf(stderr, "Rail %s: %f J of conversion losses, peak %f A and %f W, %lu in-rush violations\n", rail->name.c_str(),
+				rail->loss_energy, rail->peak_current, rail->peak_power, rail->inrush_violations);
+	}
+
+	if (!this->capping)
+		return;
+
+	fprintf(stderr, "Power cap: chip peak %f W, %lu violations\n", this->chip_peak_power, this->chip_violations);
+	for (PowerDomain *d : this->domains)
+	{
+		fprintf(stderr, "Power cap: %s peak %f W, %lu violations, throttled %.1f%% of the time\n", d->name.c_str(),
+				d->peak_power, d->violations, now > 0 ? 100.0 * d->throttled_time / now : 0.0);
+	}
+}
+
+// The busy and idle cycles are accounted up to the change of the busy status.
+// With automatic clock gating, the domain is also clock gated when its core
+// enters WFI while the domain is on, and brought back on when the core wakes
+// up, paying the on_clock_gated to on latency of the domain. States chosen by
+// the firmware are left alone.
+void PowerManager::busy_sync(vp::Block *__this, bool busy, int domain)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	PowerDomain *d = _this->domains[domain];
+
+	_this->account_leakage();
+	d->busy = busy;
+	if (!d->auto_cg)
+		return;
+
+	int state = d->event.is_enqueued() ? d->next_state : d->state.get();
+
+	if (!busy && state == _this->state_on && d->pending_state == -1)
+	{
+		PM_TRACE(_this->trace, "core of %s is idle, clock gating it\n", d->name.c_str());
+		d->auto_gated = true;
+		_this->set_target_state(domain, _this->state_cg);
+	}
+	else if (busy && d->auto_gated)
+	{
+		PM_TRACE(_this->trace, "core of %s woke up, switching it on\n", d->name.c_str());
+		d->auto_gated = false;
+		_this->set_target_state(domain, _this->state_on);
+	}
+}
+
+// The energy is accounted up to the mode change, and the peaks are updated with
+// the power of the new mode. Modes out of the table are taken as drawing no
+// dynamic power.
+void PowerManager::mode_sync(vp::Block *__this, int mode, int domain)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	PowerDomain *d = _this->domains[domain];
+
+	_this->account_leakage();
+	PM_TRACE(_this->trace, "%s switched to mode %d\n", d->name.c_str(), mode);
+	d->mode = mode;
+	_this->track_peaks();
+}
+
+void PowerManager::activity_sync(vp::Block *__this, pm_activity *activity, int domain)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	_this->domains[domain]->activity = activity;
+}
+
+// The busy and idle cycles of the domains with a busy status come from the
+// manager, the other counters from the component, or for a domain without
+// counters from the accesses to its children seen by the manager
+pm_activity PowerManager::sample_activity(int domain)
+{
+	PowerDomain *d = this->domains[domain];
+	pm_activity activity = {};
+	if (d->activity != NULL)
+		activity = *d->activity;
+	else
+	{
+		activity.requests = d->tap_requests;
+		activity.bytes = d->tap_bytes;
+	}
+	if (d->has_busy)
+	{
+		this->account_leakage();
+		activity.busy_cycles = d->busy_cycles;
+		activity.idle_cycles = d->idle_cycles;
+	}
+	return activity;
+}
+
+// Frequency of the clock of a domain, given by its operating point if the
+// manager drives its clock, and otherwise taken as the one of the manager clock
+int64_t PowerManager::domain_frequency(PowerDomain *d)
+{
+	if (d->governed && d->frequency_ctrl_itf.is_bound())
+		return this->opps[d->opp].frequency;
+	return this->clock.get_frequency();
+}
+
+// Each domain has a window of 64-bit counters. Reading the low word of a
+// counter samples all the counters of the domain, and the high word is then
+// read from the same sample.
+vp::IoReqStatus PowerManager::handle_activity(vp::Block *__this, vp::IoReq *req)
+{
+	PowerManager *_this = (PowerManager *)__this;
+	unsigned int domain = req->get_addr() / ACTIVITY_WINDOW_SIZE;
+	unsigned int offset = req->get_addr() % ACTIVITY_WINDOW_SIZE;
+
+	if (req->get_is_write())
+		return vp::IoReqStatus::IO_REQ_OK;
+
+	memset(req->get_data(), 0, req->get_size());
+	if (domain >= _this->domains.size())
+	{
+		PM_TRACE(_this->trace, "No component associated with offset %d\n", req->get_addr());
+		return vp::IoReqStatus::IO_REQ_OK;
+	}
+
+	PowerDomain *d = _this->domains[domain];
+	if (offset % sizeof(uint64_t) == 0)
+		d->activity_sample = _this->sample_activity(domain);
+	if (offset < sizeof(pm_activity))
+		memcpy(req->get_data(), (uint8_t *)&d->activity_sample + offset,
+			   std::min((uint64_t)req->get_size(), (uint64_t)(sizeof(pm_activity) - offset)));
+
 	return vp::IoReqStatus::IO_REQ_OK;
 }
 
@@ -1,39 +1,106 @@
 import gvsoc.systree as gsys
+import hashlib
 import json
+import os
 
+# size in words of the delay configuration window of each domain: 4 legacy
+# registers followed by the latency matrix
+CONFIG_WINDOW_WORDS = 64
 
-def add_ports(component_list, srcpath):
-    interfaces_generated = ""
-    ports_generated = ""
-    voltage_offsets_generated = ""
-    event_handlers=""
-    event_handlers_def=""
-    events=""
-    delay_registers=""
-    vcd_signals=""
-    event_constructors=""
-    event_handlers=""
-    delay_offsets=""
-    config_delay_offsets=""
-    addr = 0
-    addr_offsets = """// defined states in power manager
-#define off 0x0
-#define on_clock_gated 0x1
-#define on 0x3
-
-// offset to control the power measurement
-#define start_capture 0x1
-#define stop_capture 0
-
-//offsets of the config registers
-#define on_off_offset 0
-#define off_on_offset 1
-#define on_cg_offset 2
-#define cg_on_offset 3
-
-//define pm addresses mapped to components
-"""
-    # scans the component list and adds power and voltage port on the class
+
+def flatten_domains(component_list, parent=None):
+    """Flattens a component list into (name, parent) pairs, parents first.
+
+    Entries are either a component name or a dict mapping a parent component
+    to the list of its children, e.g. ["host", {"ico": ["sensor1", "sensor2"]}].
+    """
+    domains = []
+    for entry in component_list:
+        if isinstance(entry, dict):
+            for name, children in entry.items():
+                domains.append((name, parent))
+                domains.extend(flatten_domains(children, name))
+        else:
+            domains.append((entry, parent))
+    return domains
+
+
+def load_power_model(state_file, component_list):
+    """Loads the state table and the per-domain transition model.
+
+    Every domain gets a latency (ps) and an energy (pJ) matrix indexed by
+    [from][to] state, and its nominal leakage (W) used to account the power
+    left in the states where the supply is off. Its dynamic power (W) while on
+    at the nominal voltage is only used to estimate its power for capping, and
+    its in-rush gives the peak current (A) drawn when its supply is switched on,
+    decaying to 0 in duration ps.
+    """
+    with open(state_file, "r") as f:
+        model = json.load(f)
+
+    states = model["states"]
+    nb_states = len(states)
+    if 4 + nb_states * nb_states > CONFIG_WINDOW_WORDS:
+        raise RuntimeError(f"{state_file}: too many power states ({nb_states})")
+
+    domains = {}
+    for component in component_list:
+        domain = model.get("domains", {}).get(component, {})
+        latency = domain.get("latency", [[1] * nb_states for _ in range(nb_states)])
+        energy = domain.get("energy", [[0.0] * nb_states for _ in range(nb_states)])
+        for matrix in (latency, energy):
+            if len(matrix) != nb_states or any(len(row) != nb_states for row in matrix):
+                raise RuntimeError(f"{state_file}: {component} matrices must be {nb_states}x{nb_states}")
+        domains[component] = {
+            "leakage": float(domain.get("leakage", 0.0)),
+            "dynamic": float(domain.get("dynamic", 0.0)),
+            "inrush": {
+                "current": float(domain.get("inrush", {}).get("current", 0.0)),
+                "duration": int(domain.get("inrush", {}).get("duration", 0)),
+            },
+            "latency": latency,
+            "energy": [[float(value) for value in row] for row in energy],
+        }
+
+    return states, domains
+
+
+def load_rails(rails, component_list):
+    """Loads the shared regulators, given as a list or as the path of a JSON file
+    with a "rails" list (e.g. pm_rails.json).
+
+    Each rail groups domains on one regulator of type "ldo" or "buck", with its
+    input voltage (V), its quiescent current (A), its optional current limit
+    (max_current, A) checked on power-ups and, for a buck, its efficiency curve
+    as [load current (A), efficiency] points.
+    """
+    if isinstance(rails, str):
+        with open(os.path.join(os.path.dirname(__file__), rails), "r") as f:
+            rails = json.load(f)["rails"]
+
+    railed = []
+    for rail in rails:
+        if rail.get("type") not in ["ldo", "buck"]:
+            raise RuntimeError(f"rail {rail['name']}: unknown regulator type {rail.get('type')}, expected ldo or buck")
+        efficiency = sorted(rail.get("efficiency", []))
+        if rail["type"] == "buck" and (len(efficiency) == 0 or any(not 0 < point[1] <= 1 for point in efficiency)):
+            raise RuntimeError(f"rail {rail['name']}: a buck needs an efficiency curve with values in (0, 1]")
+        for domain in rail["domains"]:
+            if domain not in component_list:
+                raise RuntimeError(f"rail {rail['name']}: domain {domain} is not managed")
+            if domain in railed:
+                raise RuntimeError(f"rail {rail['name']}: domain {domain} is already on another rail")
+            railed.append(domain)
+        rail["efficiency"] = efficiency
+        rail["quiescent_current"] = float(rail.get("quiescent_current", 0.0))
+        rail["max_current"] = float(rail.get("max_current", 0.0))
+
+    return rails
+
+
+def add_ports(component_list):
+    # scans the component list and adds power and voltage port on the class,
+    # the C++ model creates the matching master ports from its "domains" config
     for component in component_list:
         power_port_name = "o_POWER_CTRL_" + component
         voltage_port_name = "o_VOLTAGE_CTRL_" + component
@@ -44,241 +111,75 @@ def add_ports(component_list, srcpath):
         def voltage_ports(self, itf: gsys.SlaveItf, name=f"voltage_ctrl_{component}"):
             self.itf_bind(name, itf, signature="wire<int>")
 
+        # taps of the accesses to the component, only created by the C++ model
+        # for the domains with wake-on-access
+        def tap_input(self, name=f"tap_in_{component}") -> gsys.SlaveItf:
+            return gsys.SlaveItf(self, name, signature="io")
+
+        def tap_output(self, itf: gsys.SlaveItf, name=f"tap_out_{component}"):
+            self.itf_bind(name, itf, signature="io")
+
         setattr(PowerManager, power_port_name, power_ports)
         setattr(PowerManager, voltage_port_name, voltage_ports)
+        setattr(PowerManager, "i_TAP_" + component, tap_input)
 
-        # port needs to be added also in the cpp file.
-        events= events + f"\tTimeEvent delay_{component};\n"
+        # counters of the component, sampled by the manager
+        def activity_input(self, name=f"activity_{component}") -> gsys.SlaveItf:
+            return gsys.SlaveItf(self, name, signature="wire<pm_activity *>")
 
-        event_handlers_def = event_handlers_def + f"\tstatic void {component}_delay_handler(vp::Block *__this, vp::TimeEvent *event);\n"
+        setattr(PowerManager, "i_ACTIVITY_" + component, activity_input)
 
-        interfaces_generated = (
-            interfaces_generated
-            + f"\tWireMaster<int> power_ctrl_itf_{component};\n\tWireMaster<double> voltage_ctrl_itf_{component};\n"
-        )
+        # busy status of the core of the component, for its busy and idle
+        # cycles and automatic clock gating
+        def busy_input(self, name=f"busy_{component}") -> gsys.SlaveItf:
+            return gsys.SlaveItf(self, name, signature="wire<bool>")
 
-        delay_registers= delay_registers + f"\tunsigned int {component}_delays[4] = {{1,1,1,1}};\n\tint {component}_next_state;\n"
+        setattr(PowerManager, "i_BUSY_" + component, busy_input)
 
-        vcd_signals= vcd_signals + f"\tvp::Signal<int> {component}_state;\n\tvp::Signal<float> {component}_voltage;\n"
+        # clock control of the component, only created by the C++ model for the
+        # governed domains, which sets the frequency of each operating point
+        def frequency_ports(self, itf: gsys.SlaveItf, name=f"frequency_ctrl_{component}"):
+            self.itf_bind(name, itf, signature="clock_ctrl")
 
-        event_constructors= event_constructors + f"\t, delay_{component}(this, {component}_delay_handler), {component}_state(*this, \"{component}_state\", 3), {component}_voltage(*this, \"{component}_voltage\", 32) "
+        setattr(PowerManager, "o_FREQUENCY_CTRL_" + component, frequency_ports)
 
-        ports_generated = (
-            ports_generated
-            + f'\tthis->new_master_port("power_ctrl_{component}", &this->power_ctrl_itf_{component});\n\tthis->new_master_port("voltage_ctrl_{component}", &this->voltage_ctrl_itf_{component});\n'
-        )
+        # power mode of the component, which selects its power in mode_power
+        def mode_input(self, name=f"mode_{component}") -> gsys.SlaveItf:
+            return gsys.SlaveItf(self, name, signature="wire<int>")
 
-        event_handlers=event_handlers+f"void PowerManager::{component}_delay_handler(vp::Block *__this, vp::TimeEvent *event)\n{{\n\tPowerManager *_this = (PowerManager *)__this;\n\t_this->power_ctrl_itf_{component}.sync(_this->{component}_next_state);\n\t_this->trace.msg(vp::TraceLevel::DEBUG, \"switching power state of {component} to %s\\n\", statename[_this->{component}_next_state]);\n_this->{component}_state.set(_this->{component}_next_state);\n}}\n"
-
-        delay_offsets = delay_offsets + f"""
-        case {addr*4}:
-			if (!_this->delay_{component}.is_enqueued())
-			{{
-				_this->{component}_next_state = power_state;
-				// if next state is on check previous state
-				if (power_state == ON)
-				{{
-					if (_this->{component}_state.get() == OFF)
-						picoseconds = _this->{component}_delays[1];//off-on
-					else
-						picoseconds = _this->{component}_delays[3];//cg-on
-				}}
-				else if (power_state == OFF)
-				{{
-					picoseconds = _this->{component}_delays[0];//on-off
-				}}
-				else
-					picoseconds = _this->{component}_delays[2];//on-cg
-
-				_this->delay_{component}.enqueue(picoseconds);
-			}}
-			else
-				_this->trace.msg(vp::TraceLevel::DEBUG, "Last change of {component} is still  in progress...\\n");
-			break;
-"""
-
-        voltage_offsets_generated = (
-            voltage_offsets_generated
-            + f'\t\tcase {addr*4}:\n\t\t\t_this->voltage_ctrl_itf_{component}.sync(_this->to_change.voltage);\n\t\t\t_this->trace.msg(vp::TraceLevel::DEBUG, "switching voltage of {component} to %f\\n", _this->to_change.voltage);\n\t\t\t_this->{component}_voltage.set(_this->to_change.voltage);\n\n\t\t\tbreak;\n'
-        )
+        setattr(PowerManager, "i_MODE_" + component, mode_input)
+        setattr(PowerManager, "o_TAP_" + component, tap_output)
 
-        config_delay_offsets = config_delay_offsets + f"""
-        case {addr*16}:
-		case {addr*16+4}:
-		case {addr*16+8}:
-		case {addr*16+12}:
-			_this->{component}_delays[(addr-{addr*16})/4] = value;
-			_this->trace.msg(vp::TraceLevel::DEBUG, "New configuration is: on-off: %d, off-on: %d, on-cg: %d, cg-on: %d\\n", _this->{component}_delays[0],_this->{component}_delays[1],_this->{component}_delays[2],_this->{component}_delays[3]);
-		break;
-"""
-
-        addr_offsets = addr_offsets + f"#define {component}_offset {addr}\n#define {component}_config_offset {addr*4}\n"
+
+def write_if_changed(path, content):
+    """Writes a generated file only when the hash of its content changed, so that
+    an unchanged header keeps its timestamp and nothing including it is rebuilt."""
+    digest = hashlib.sha256(content.encode()).hexdigest()
+    if os.path.exists(path):
+        with open(path, "rb") as f:
+            if hashlib.sha256(f.read()).hexdigest() == digest:
+                return
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w") as f:
+        f.write(content)
+
+
+def gen_headers(component_list, gen_dir, states):
+    # the constant part of the register map is in pm_addr.h, which includes
+    # the two headers generated here from the state table and the domains
+    states_header = "// defined states in power manager\n"
+    for index, state in enumerate(states):
+        states_header = states_header + f"#define {state['name']} {index:#x}\n"
+    states_header = states_header + f"#define nb_power_states {len(states)}\n"
+
+    addr = 0
+    domains_header = "//define pm addresses mapped to components\n"
+    for component in component_list:
+        domains_header = domains_header + f"#define {component}_offset {addr}\n#define {component}_config_offset {addr*CONFIG_WINDOW_WORDS}\n"
         addr = addr + 1
 
-    # write offsets to a header file
-    with open(srcpath.replace("power_manager.cpp", "pm_addr.h"), "w") as f:
-        f.writelines(addr_offsets)
-
-    # updates the source file template
-    with open(srcpath, "r") as f:
-        lines = f.readlines()
-    result = []
-
-    in_block = False
-
-    for line in lines:
-
-        if "// GENERATED EVENTS" in line:
-            result.append(line)
-            result.extend(events)
-            in_block = True
-            continue
-
-        if "// END GENERATED EVENTS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue
-
-        if "// GENERATED EVENT HANDLER DEFINITIONS" in line:
-            result.append(line)
-            result.extend(event_handlers_def)
-            in_block = True
-            continue
-
-        if "// END EVENT HANDLER DEFNITIONS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue
-
-        if "// GENERATED INTERFACES" in line:
-            result.append(line)
-            result.extend(interfaces_generated)
-            in_block = True
-            continue
-
-        if "// END INTERFACES" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue
-
-        if "// GENERATED DELAY REGISTERS" in line:
-            result.append(line)
-            result.extend(delay_registers)
-            in_block = True
-            continue
-
-        if "// END DELAY REGISTERS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue 
-        
-        if "// GENERATED VCD PS SIGNAL" in line:
-            result.append(line)
-            result.extend(vcd_signals)
-            in_block = True
-            continue
-
-        if "// END GENERATED VCD PS SIGNAL" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue 
-
-        if "// GENERATED EVENT CONSTRUCTORS" in line:
-            result.append(line)
-            result.extend(event_constructors)
-            in_block = True
-            continue
-
-        if "// END EVENT CONSTRUCTORS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue              
-
-        if "// GENERATED POWER AND VOLTAGE PORTS" in line:
-            result.append(line)
-            result.extend(ports_generated)
-            in_block = True
-            continue
-
-        if "// END GENERATED PORTS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue
-
-        if "// GENERATED EVENT HANDLERS" in line:
-            result.append(line)
-            result.extend(event_handlers)
-            in_block = True
-            continue
-
-        if "// END EVENT HANDLERS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue
-
-        if "// GENERATED DELAY OFFSETS" in line:
-            result.append(line)
-            result.extend(delay_offsets)
-            in_block = True
-            continue
-
-        if "// END GENERATED DELAY OFFSETS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue
-
-        if "// GENERATED VOLTAGE OFFSETS" in line:
-            result.append(line)
-            result.extend(voltage_offsets_generated)
-            in_block = True
-            continue
-
-        if "// END GENERATED VOLTAGE OFFSETS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue
-
-        if "// GENERATED CONFIG DELAY OFFSETS" in line:
-            result.append(line)
-            result.extend(config_delay_offsets)
-            in_block = True
-            continue
-
-        if "// END GENERATED CONFIG DELAY OFFSETS" in line:
-            in_block = False
-            result.append("\n" + line)
-            continue
-
-        if not in_block:
-            result.append(line)
-
-    with open(srcpath, "w") as file:
-        file.writelines(result)
-
-
-
-# clean the source file from the generated components
-def clean_src(src_file):
-    with open(src_file, "r") as file:
-        lines = file.readlines()
-    result = []
-    in_block = False
-    for line in lines:
-        if "END" in line:
-            result.append(line)
-            in_block = False
-            continue
-
-        if "GENERATED" in line:
-            result.append(line)
-            in_block = True
-            continue
-
-        if not in_block:
-            result.append(line)
-            continue
-    with open(src_file, "w") as file:
-        file.writelines(result)
+    write_if_changed(os.path.join(gen_dir, "pm_states.h"), states_header)
+    write_if_changed(os.path.join(gen_dir, "pm_domains.h"), domains_header)
 
 
 class PowerManager(gsys.Component):
@@ -288,22 +189,198 @@ class PowerManager(gsys.Component):
         name: str,
         schedule=False,
         schedule_file="attributes.json",
-        component_list=None
+        component_list=None,
+        edge_delays=None,
+        state_file="pm_states.json",
+        gen_dir=None,
+        release=False,
+        controller=None,
+        controller_epoch=1000000,
+        controller_timeout=1000,
+        telemetry=None,
+        wake_on_access=None,
+        governor=None,
+        governor_policy="conservative",
+        governor_period=100000000,
+        opps=None,
+        up_threshold=0.8,
+        down_threshold=0.3,
+        down_samples=2,
+        power_cap=None,
+        domain_caps=None,
+        cap_period=10000000,
+        cap_release=0.9,
+        throttle_order=None,
+        nominal_voltage=1.2,
+        rails=None,
+        inrush_policy="flag",
+        auto_cg=None,
+        busy=None,
+        mode_power=None,
+        nested=None
     ):
         super().__init__(parent, name)
-        src_file = self.get_file_path("power_manager.cpp")
         if component_list is None:
-            self.component_list = list(parent.components.keys())
-            self.component_list.remove(name)
-        else:
-            self.component_list = component_list
+            component_list = list(parent.components.keys())
+            component_list.remove(name)
+        domains = flatten_domains(component_list)
+        self.component_list = [domain for domain, _ in domains]
         print("detected components: ", self.component_list)
 
-        clean_src(src_file)
+        states, power_model = load_power_model(
+            os.path.join(os.path.dirname(__file__), state_file), self.component_list
+        )
+
+        # edge_delays gives, for a child domain, the time in ps between its parent
+        # reaching ON and the child starting to power up
+        if edge_delays is None:
+            edge_delays = {}
+        if controller is not None and controller_timeout <= 0:
+            raise RuntimeError(f"controller timeout must be positive, got {controller_timeout} ms")
+        # domains powered up by the first access to their component, which must
+        # then be mapped through i_TAP_<domain> and o_TAP_<domain>
+        if wake_on_access is None:
+            wake_on_access = []
+        for domain in wake_on_access:
+            if domain not in self.component_list:
+                raise RuntimeError(f"wake-on-access domain {domain} is not managed")
+        # domains whose component is inside the component of their parent
+        # domain, e.g. the FC inside the host, get their supply back after
+        # their parent changed it
+        if nested is None:
+            nested = []
+        for domain, parent_domain in domains:
+            if domain in nested and parent_domain is None:
+                raise RuntimeError(f"nested domain {domain} has no parent domain")
+        # domains clock gated while their core waits for an interrupt, whose
+        # busy status must be bound to i_BUSY_<domain>
+        if auto_cg is None:
+            auto_cg = []
+        for domain in auto_cg:
+            if domain not in self.component_list:
+                raise RuntimeError(f"automatically clock gated domain {domain} is not managed")
+        # domains whose busy cycles and idle cycles are counted by the manager
+        # from the busy status of their core, bound to i_BUSY_<domain>, which
+        # the automatically clock gated domains also need
+        if busy is None:
+            busy = []
+        for domain in busy:
+            if domain not in self.component_list:
+                raise RuntimeError(f"domain {domain} with a busy status is not managed")
+        busy = set(busy) | set(auto_cg)
+        # power in W at the nominal voltage of each mode of the domains whose
+        # component reports its mode to i_MODE_<domain>, used for capping in
+        # place of their dynamic power
+        if mode_power is None:
+            mode_power = {}
+        for domain in mode_power:
+            if domain not in self.component_list:
+                raise RuntimeError(f"domain {domain} with mode powers is not managed")
+        # domains grouped on shared regulators, whose conversion losses are
+        # added to the power report
+        if rails is not None:
+            self.add_properties({"rails": load_rails(rails, self.component_list)})
+        # power-ups exceeding the current limit of their rail are reported
+        # (flag) or delayed until the in-rush of the others is over (serialize)
+        if inrush_policy not in ["flag", "serialize"]:
+            raise ValueError(f"unknown in-rush policy {inrush_policy}, expected flag or serialize")
+        self.add_properties({"inrush_policy": inrush_policy})
+
+        # the governor and the power cap move the domains between operating
+        # points of (voltage in V, frequency in Hz)
+        if opps is None:
+            opps = [(0.8, 25000000), (1.0, 40000000), (1.2, 50000000)]
+        self.add_properties(
+            {"opps": [{"voltage": voltage, "frequency": frequency} for voltage, frequency in sorted(opps)]}
+        )
+        if governor_policy not in ["ondemand", "conservative"]:
+            raise ValueError(f"unknown governor policy {governor_policy}, expected ondemand or conservative")
+        if down_threshold >= up_threshold:
+            raise ValueError("the governor down_threshold must be below up_threshold")
+        if governor is not None:
+            for domain in governor:
+                if domain not in self.component_list:
+                    raise RuntimeError(f"governed domain {domain} is not managed")
+            self.add_properties(
+                {
+                    "governor": {
+                        "domains": governor,
+                        "policy": governor_policy,
+                        "period": governor_period,
+                        "up_threshold": up_threshold,
+                        "down_threshold": down_threshold,
+                        "down_samples": down_samples,
+                    }
+                }
+            )
+        # power_cap is the chip budget and domain_caps the budgets of some domains,
+        # in W, enforced on the power estimated over windows of cap_period ps.
+        # For the chip budget, the domains are throttled in throttle_order, by
+        # default the children before their parents.
+        if power_cap is not None or domain_caps is not None:
+            if domain_caps is None:
+                domain_caps = {}
+            if throttle_order is None:
+                throttle_order = list(reversed(self.component_list))
+            for domain in list(domain_caps.keys()) + throttle_order:
+                if domain not in self.component_list:
+                    raise RuntimeError(f"capped domain {domain} is not managed")
+            self.add_properties(
+                {
+                    "power_cap": {
+                        "chip": power_cap if power_cap is not None else 0.0,
+                        "domains": domain_caps,
+                        "period": cap_period,
+                        "release": cap_release,
+                        "throttle_order": throttle_order,
+                        "nominal_voltage": nominal_voltage,
+                    }
+                }
+            )
+        self.add_properties(
+            {
+                "states": states,
+                "domains": [
+                    {
+                        "name": domain,
+                        "parent": -1 if parent_domain is None else self.component_list.index(parent_domain),
+                        "edge_delay": edge_delays.get(domain, 0),
+                        "wake_on_access": domain in wake_on_access,
+                        "auto_cg": domain in auto_cg,
+                        "busy": domain in busy,
+                        "modes": [float(power) for power in mode_power.get(domain, [])],
+                        "nested": domain in nested,
+                        **power_model[domain],
+                    }
+                    for domain, parent_domain in domains
+                ],
+                # shared memory channel of an external policy controller, which
+                # takes decisions every controller_epoch ps, and is detached
+                # if it doesn't answer within controller_timeout ms
+                "controller": {
+                    "channel": controller if controller is not None else "",
+                    "epoch": controller_epoch,
+                    "timeout": controller_timeout,
+                },
+                # file mirroring the state of the domains, read by pm_top
+                "telemetry": telemetry if telemetry is not None else "",
+            }
+        )
 
-        add_ports(self.component_list, src_file)
+        add_ports(self.component_list)
+
+        # generated headers go to the build directory, never to the source tree
+        if gen_dir is None:
+            gen_dir = os.path.join(os.path.dirname(__file__), "build")
+        gen_headers(self.component_list, gen_dir, states)
 
         self.add_sources(["power_manager.cpp"])
+        # release builds compile the debug traces out of the MMIO handlers
+        if release:
+            self.add_c_flags(["-DPM_NO_TRACE"])
+
+    def o_MARKER(self, itf: gsys.SlaveItf):
+        self.itf_bind("marker", itf, signature="io")
 
     def i_INPUT_STATE(self) -> gsys.SlaveItf:
         return gsys.SlaveItf(self, "state_ctrl", signature="io")
@@ -320,3 +397,6 @@ class PowerManager(gsys.Component):
     def i_DELAY_VOLTAGE_CONFIG(self) -> gsys.SlaveItf:
         return gsys.SlaveItf(self, "voltage_delay_config", signature="io")
 
+    def i_ACTIVITY(self) -> gsys.SlaveItf:
+        return gsys.SlaveItf(self, "activity", signature="io")
+
@@ -0,0 +1,23 @@
+// Register map of the GenericSensor, offsets in bytes from the base of each
+// sensor
+#define sensor_data 0x00
+#define sensor_ctrl 0x04
+#define sensor_period 0x08
+#define sensor_watermark 0x0c
+#define sensor_level 0x10
+#define sensor_status 0x14
+// address where the samples are pushed in one write when the watermark is
+// reached, 0 to leave them in the FIFO
+#define sensor_dma_addr 0x18
+// reads in this window pop samples from the FIFO, one per word
+#define sensor_fifo 0x40
+
+// bits of the control register
+#define sensor_ctrl_sampling 0x1
+
+// bits of the status register, written with 1 to clear them
+#define sensor_status_watermark 0x1
+#define sensor_status_overflow 0x2
+// a batch of watermark samples was pushed to sensor_dma_addr, no other push
+// happens until it is cleared
+#define sensor_status_dma 0x4
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Design-space sweep of the DPM system.
+
+Runs one simulation through the launcher for each point of the cross product
+of a parameter grid, using several host cores, and gathers the results in a
+CSV file. The grid is a JSON file such as:
+
+{
+    "binaries": {"fast_workload": "binaries/fast_workload", "fast_workload_on_off": "..."},
+    "workloads": ["fast_workload", "slow_workload"],
+    "policies": ["", "_on_off", "_nodpm"],
+    "state_delays": [[50000, 20000, 40000, 30000]],
+    "voltages": [0.8, 1.2]
+}
+
+A workload and a policy select the binary named <workload><policy>. The state
+delays (on-off, off-on, on-cg, cg-on) and the voltage are written to the host
+registers of the PowerManager when the firmware signals the end of its setup
+(marker_setup), so that its own configuration doesn't overwrite them. Some
+policies still write these registers during the run, e.g. the host voltage at
+each iteration with DVFS, so an axis only makes sense for the policies which
+leave its registers alone. The grid can thus be split in sub-grids, listed in
+"grids", each one giving the axes it overrides, the others being taken from the
+top level:
+
+    "grids": [
+        {"policies": [""]},
+        {"policies": ["_on_off"], "state_delays": [[50000, 20000, 40000, 30000]]},
+        {"policies": ["_nodpm"], "voltages": [0.8, 1.2]}
+    ]
+
+Every point runs in its own work directory, where its configuration is
+prepared with the PowerManager routed through the launcher, which needs to
+receive the marker. The register addresses come from pm_addr.h and from the
+pm_domains.h generated in the work directory.
+"""
+
+import argparse
+import csv
+import itertools
+import json
+import os
+import queue
+import re
+import struct
+import subprocess
+import threading
+import time
+
+DEFINE = re.compile(r"^#define\s+(\w+)\s+(\w+)\s*$", re.MULTILINE)
+# registers of the state delays, in their order in the grid
+DELAY_REGS = ["on_off_offset", "off_on_offset", "on_cg_offset", "cg_on_offset"]
+
+MEASURE = re.compile(r"@power\.measure_(\d+)@([-0-9.e+]+)@")
+CAPTURE_START = re.compile(r"@power\.capture_start_(\d+)@")
+FIELDS = ["point", "workload", "policy", "state_delays", "voltage", "status",
+          "attempts", "energy", "sim_time", "average_power", "wall_time"]
+
+
+def points(grid):
+    result = []
+    top = {key: value for key, value in grid.items() if key != "grids"}
+    for sub_grid in grid.get("grids", [{}]):
+        axes = {**top, **sub_grid}
+        for workload, policy, delays, voltage in itertools.product(
+            axes["workloads"],
+            axes.get("policies", [""]),
+            axes.get("state_delays", [None]),
+            axes.get("voltages", [None]),
+        ):
+            point = {"workload": workload, "policy": policy, "state_delays": delays, "voltage": voltage}
+            if point not in result:
+                result.append(point)
+    return result
+
+
+def read_defines(*paths):
+    """Returns the integer macros of the given headers."""
+    defines = {}
+    for path in paths:
+        with open(path) as header:
+            for name, value in DEFINE.findall(header.read()):
+                try:
+                    defines[name] = int(value, 0)
+                except ValueError:
+                    pass
+    return defines
+
+
+def overrides(point, defines):
+    result = []
+    if point["state_delays"] is not None:
+        for reg, delay in zip(DELAY_REGS, point["state_delays"]):
+            result.append((defines["pm_config_delay_state"] + (defines["host_config_offset"] + defines[reg]) * 4, delay))
+    if point["voltage"] is not None:
+        # the voltage register holds a float
+        bits = struct.unpack("<I", struct.pack("<f", point["voltage"]))[0]
+        result.append((defines["pm_voltage"] + defines["host_offset"] * 4, bits))
+    return [f"--override=0x{addr:x}={value}" for addr, value in result]
+
+
+def parse_log(log):
+    """Returns the energy in J and the duration in ps of the last power capture."""
+    # the PowerManager prints the start of a capture, and its average power at
+    # its stop
+    measures = [(int(t), float(p)) for t, p in MEASURE.findall(log)]
+    if len(measures) == 0:
+        return None, None, None
+    stop, power = measures[-1]
+    starts = [int(t) for t in CAPTURE_START.findall(log) if int(t) <= stop]
+    if len(starts) == 0:
+        return None, None, None
+    duration = stop - starts[-1]
+    return power * duration * 1e-12, duration, power
+
+
+def run_point(args, index, point, binary):
+    work_dir = os.path.abspath(os.path.join(args.work_dir, f"point_{index}"))
+    os.makedirs(work_dir, exist_ok=True)
+    log_path = os.path.join(work_dir, "sim.log")
+    with open(log_path, "w") as log:
+        prepare = subprocess.run(
+            ["gvsoc", f"--target-dir={args.target_dir}", "--target=my_system",
+             f"--work-dir={work_dir}", f"--binary={os.path.abspath(binary)}", "prepare", "--pm-routing=launcher"],
+            stdout=log, stderr=subprocess.STDOUT,
+        )
+        if prepare.returncode != 0:
+            return prepare.returncode, None
+        defines = read_defines(os.path.join(args.target_dir, "pm_addr.h"), os.path.join(work_dir, "pm_domains.h"))
+        start = time.monotonic()
+        sim = subprocess.run(
+            [args.launcher, f"--config={os.path.join(work_dir, 'gvsoc_config.json')}",
+             f"--override-marker={defines['marker_setup']}", *overrides(point, defines)],
+            stdout=log, stderr=subprocess.STDOUT, timeout=args.timeout,
+        )
+        wall = time.monotonic() - start
+    with open(log_path) as log:
+        return sim.returncode, (parse_log(log.read()), wall)
+
+
+def worker(args, grid, jobs, results, lock):
+    while True:
+        try:
+            index, point = jobs.get_nowait()
+        except queue.Empty:
+            return
+        binary = grid["binaries"].get(point["workload"] + point["policy"])
+        row = {"point": index, **point, "status": "no binary", "attempts": 0}
+        for attempt in range(1, args.retries + 2 if binary is not None else 1):
+            row["attempts"] = attempt
+            try:
+                status, output = run_point(args, index, point, binary)
+            except subprocess.TimeoutExpired:
+                status, output = "timeout", None
+            except Exception as error:
+                # the point is reported as failed rather than lost with its thread
+                status, output = f"error: {error}", None
+            if status == 0 and output is not None and output[0][0] is not None:
+                (energy, sim_time, power), wall = output
+                row.update(status="ok", energy=energy, sim_time=sim_time,
+                           average_power=power, wall_time=wall)
+                break
+            row["status"] = status
+        with lock:
+            results.append(row)
+            print(f"[{len(results)}/{args.nb_points}] point {index} {point['workload']}{point['policy']}: {row['status']}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("grid", help="JSON file describing the parameter grid")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="number of parallel simulations")
+    parser.add_argument("--retries", type=int, default=1, help="number of retries of a failed point")
+    parser.add_argument("--timeout", type=float, default=None, help="timeout of a simulation in seconds")
+    parser.add_argument("--work-dir", default="build/sweep", help="directory of the work directories of the points")
+    parser.add_argument("--output", default="result/sweep.csv", help="CSV file of the results")
+    parser.add_argument("--launcher", default=os.path.abspath("launcher"), help="path of the launcher")
+    parser.add_argument("--target-dir", default=os.path.dirname(os.path.abspath(__file__)))
+    args = parser.parse_args()
+
+    with open(args.grid) as file:
+        grid = json.load(file)
+
+    jobs = queue.Queue()
+    for index, point in enumerate(points(grid)):
+        jobs.put((index, point))
+    args.nb_points = jobs.qsize()
+
+    results = []
+    lock = threading.Lock()
+    # each thread takes points from the queue and runs them in a separate
+    # process, so the simulations use one host core each
+    threads = [
+        threading.Thread(target=worker, args=(args, grid, jobs, results, lock))
+        for _ in range(min(args.jobs, args.nb_points))
+    ]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+    os.makedirs(os.path.dirname(os.path.abspath(args.output)), exist_ok=True)
+    with open(args.output, "w", newline="") as file:
+        writer = csv.DictWriter(file, fieldnames=FIELDS)
+        writer.writeheader()
+        for row in sorted(results, key=lambda row: row["point"]):
+            writer.writerow(row)
+
+    return 0 if all(row["status"] == "ok" for row in results) else 1
+
+
+if __name__ == "__main__":
+    exit(main())